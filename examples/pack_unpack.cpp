@@ -29,6 +29,51 @@ namespace
 		}
 	}
 
+	// compresses files in bounded batches while the input is walked, so only a
+	// handful of input files are mapped (or held uncompressed) at any one time
+	template <class Archive, class File, class Params>
+	class compression_batch final
+	{
+	public:
+		explicit compression_batch(Params a_params) :
+			_params(std::move(a_params))
+		{
+			_files.reserve(batch_size);
+		}
+
+		template <class Insert>
+		void push(std::filesystem::path a_path, File a_file, Insert&& a_insert)
+		{
+			_files.emplace_back(std::move(a_path), std::move(a_file));
+			if (_files.size() >= batch_size) {
+				this->flush(a_insert);
+			}
+		}
+
+		template <class Insert>
+		void flush(Insert&& a_insert)
+		{
+			std::vector<File*> files;
+			files.reserve(_files.size());
+			for (auto& [path, file] : _files) {
+				files.push_back(&file);
+			}
+
+			Archive::compress(files, _params, _executor);
+			for (auto& [path, file] : _files) {
+				a_insert(path, std::move(file));
+			}
+			_files.clear();
+		}
+
+	private:
+		static constexpr std::size_t batch_size = 256;
+
+		std::vector<std::pair<std::filesystem::path, File>> _files;
+		Params _params;
+		bsa::executor _executor{ bsa::make_thread_executor() };  // one pool, reused by every batch
+	};
+
 	template <class... Keys>
 	[[nodiscard]] auto virtual_to_local_path(Keys&&... a_keys)
 		-> std::string
@@ -61,24 +106,24 @@ namespace
 		const std::filesystem::path& a_output)
 	{
 		bsa::fo4::archive ba2;
+		const auto insert = [&](const std::filesystem::path& a_path, bsa::fo4::file&& a_file) {
+			ba2.insert(
+				a_path
+					.lexically_relative(a_input)
+					.lexically_normal()
+					.generic_string(),
+				std::move(a_file));
+		};
+
+		compression_batch<bsa::fo4::archive, bsa::fo4::file, bsa::fo4::chunk::compression_params> batch{ {} };
 		for_each_file(
 			a_input,
 			[&](const std::filesystem::path& a_path) {
 				bsa::fo4::file f;
-				f.read(
-					a_path,
-					{
-						.format_ = bsa::fo4::format::general,
-						.compression_type_ = bsa::compression_type::compressed,
-					});
-
-				ba2.insert(
-					a_path
-						.lexically_relative(a_input)
-						.lexically_normal()
-						.generic_string(),
-					std::move(f));
+				f.read(a_path, { .format_ = bsa::fo4::format::general });
+				batch.push(a_path, std::move(f), insert);
 			});
+		batch.flush(insert);
 		ba2.write(a_output, { .format_ = bsa::fo4::format::general });
 	}
 
@@ -90,6 +135,9 @@ namespace
 		for_each_file(
 			a_input,
 			[&](const std::filesystem::path& a_path) {
+				// tes3 archives aren't compressed, so every input file stays mapped until the
+				// write, unlike with the compressed formats. Mapped pages are backed by the input
+				// files, so the kernel can reclaim them, which it couldn't do for a copy on the heap
 				bsa::tes3::file f;
 				f.read(a_path);
 
@@ -113,37 +161,34 @@ namespace
 			bsa::tes4::archive_flag::compressed |
 			bsa::tes4::archive_flag::directory_strings |
 			bsa::tes4::archive_flag::file_strings);
+		const auto insert = [&](const std::filesystem::path& a_path, bsa::tes4::file&& a_file) {
+			const auto key =
+				a_path
+					.parent_path()
+					.lexically_relative(a_input)
+					.lexically_normal()
+					.generic_string();
+			auto& d = bsa.try_emplace(key).first->second;
+
+			d.insert(
+				a_path
+					.filename()
+					.lexically_normal()
+					.generic_string(),
+				std::move(a_file));
+		};
+
+		compression_batch<bsa::tes4::archive, bsa::tes4::file, bsa::tes4::file::compression_params> batch{
+			{ .version_ = version },
+		};
 		for_each_file(
 			a_input,
 			[&](const std::filesystem::path& a_path) {
 				bsa::tes4::file f;
-				f.read(
-					a_path,
-					{
-						.version_ = version,
-						.compression_type_ = bsa::compression_type::compressed,
-					});
-
-				const auto d = [&]() {
-					const auto key =
-						a_path
-							.parent_path()
-							.lexically_relative(a_input)
-							.lexically_normal()
-							.generic_string();
-					if (bsa.find(key) == bsa.end()) {
-						bsa.insert(key, bsa::tes4::directory());
-					}
-					return bsa[key];
-				}();
-
-				d->insert(
-					a_path
-						.filename()
-						.lexically_normal()
-						.generic_string(),
-					std::move(f));
+				f.read(a_path, { .version_ = version });
+				batch.push(a_path, std::move(f), insert);
 			});
+		batch.flush(insert);
 		bsa.write(a_output, version);
 	}
 
@@ -154,7 +199,7 @@ namespace
 		bsa::fo4::archive ba2;
 		const auto meta = ba2.read(a_input);
 
-		for (auto& [key, file] : ba2) {
+		for (const auto& [key, file] : ba2) {
 			auto out = open_virtual_path(a_output, key);
 			file.write(out, { .format_ = meta.format_, .compression_format_ = meta.compression_format_ });
 		}
@@ -180,8 +225,8 @@ namespace
 		bsa::tes4::archive bsa;
 		const auto format = bsa.read(a_input);
 
-		for (auto& dir : bsa) {
-			for (auto& file : dir.second) {
+		for (const auto& dir : bsa) {
+			for (const auto& file : dir.second) {
 				auto out = open_virtual_path(a_output, dir.first, file.first);
 				file.second.write(out, { .version_ = format });
 			}
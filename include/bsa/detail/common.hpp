@@ -6,14 +6,18 @@
 #include <concepts>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <exception>
 #include <filesystem>
+#include <functional>
+#include <iterator>
 #include <map>
 #include <memory>
 #include <optional>
 #include <span>
 #include <string>
 #include <string_view>
+#include <tuple>
 #include <type_traits>
 #include <utility>
 #include <variant>
@@ -121,6 +125,20 @@ namespace bsa
 		shallow
 	};
 
+	/// \brief	Who owns the mapping when reading from files on the native filesystem.
+	enum class map_ownership
+	{
+		/// \brief	Every entry read from the file shares ownership of the mapping, so entries
+		///		remain valid even after the archive they were read from is destroyed.
+		shared,
+
+		/// \brief	The archive is the sole owner of the mapping, and entries hold lightweight views
+		///		into it. Entries are only valid for as long as the archive they were read from (or a
+		///		copy of it) is alive, but reading and destroying the archive no longer pays for
+		///		reference counting on every entry.
+		archive
+	};
+
 	/// \brief	Indicates whether the operation should finish by compressing the data or not.
 	enum class compression_type
 	{
@@ -131,6 +149,21 @@ namespace bsa
 		compressed
 	};
 
+	/// \brief	Trades compression speed against compression ratio.
+	/// \remark	Every preset produces data the games can read. Only the time taken to compress,
+	///		and the size of the result, differ.
+	enum class compression_preset
+	{
+		/// \brief	Compresses as quickly as the codec allows, at the cost of a worse ratio.
+		fast,
+
+		/// \brief	Compresses at the level the official archive tools use.
+		normal,
+
+		/// \brief	Compresses as small as the codec allows, at the cost of speed.
+		max
+	};
+
 	/// \brief	The file format for a given archive.
 	enum class file_format
 	{
@@ -266,12 +299,44 @@ namespace bsa
 		}
 		return result;
 	}
+
+	/// \brief	Runs a batch of independent tasks.
+	/// \details	An executor is invoked with the number of tasks to run, and a function to run them
+	///		with. It *must* invoke the function exactly once with every index in `[0, count)`, and
+	///		*must not* return until every invocation has finished. The function may be invoked
+	///		concurrently from any number of threads.
+	///
+	///		Tasks *should* be started in ascending order of their index. This isn't needed for
+	///		correctness, but the library orders its batches so that work which must start first
+	///		(such as writing out the previous window of compressed files) has the lowest index.
+	///		An executor which starts tasks in any other order still produces the same results,
+	///		but may overlap less of the work.
+	/// \remark	An empty executor runs every task on the calling thread, in ascending order.
+	using executor = std::function<void(std::size_t, const std::function<void(std::size_t)>&)>;
+
+	/// \brief	Creates an \ref executor which spreads tasks over a pool of threads.
+	/// \details	The calling thread participates in the work. The other threads are started once,
+	///		when the executor is created, and are reused by every batch it runs. They are shared
+	///		by all copies of the executor, and are stopped once the last copy is destroyed.
+	///		The executor may be invoked concurrently, and from within one of its own tasks. Tasks
+	///		are started in ascending order of their index.
+	///
+	/// \param	a_threads	The maximum number of threads to run tasks on, including the calling
+	///		thread. `0` uses `std::thread::hardware_concurrency()`.
+	[[nodiscard]] auto make_thread_executor(std::size_t a_threads = 0) -> executor;
+
+	/// \brief	Retrieves the \ref executor which is used whenever one isn't given.
+	/// \details	A \ref make_thread_executor "thread executor" using every hardware thread,
+	///		which is shared by the whole process. Its threads are started the first time it's
+	///		retrieved, and are kept until the process exits, so that calls which rely on the
+	///		default don't each start and stop a pool of their own.
+	[[nodiscard]] auto default_executor() -> const executor&;
 }
 
 #ifndef DOXYGEN
 namespace bsa::detail
 {
-	using ostream_t = binary_io::any_ostream;
+	class ostream_t;
 
 #	define BSA_ENUMERATE(F)                                                                         \
 		F(none, "dummy error")                                                                       \
@@ -338,13 +403,227 @@ namespace bsa::detail
 		}
 	}
 
+	// paths at least this long are treated as the empty path
+	inline constexpr std::size_t max_path = 260;
+
 	void normalize_path(std::string& a_path) noexcept;
 
+	// normalizes a_path into a_buffer, and returns a view of the result
+	[[nodiscard]] auto normalize_path(
+		std::string_view a_path,
+		std::span<char, max_path> a_buffer) noexcept
+		-> std::string_view;
+
+	// a character at a time version of normalize_path, which is usable in constant expressions
+	[[nodiscard]] constexpr auto normalize_path_constexpr(
+		std::string_view a_path,
+		std::span<char, max_path> a_buffer) noexcept
+		-> std::string_view
+	{
+		const auto first = a_path.find_first_not_of("/\\"sv);
+		if (first == std::string_view::npos) {
+			return "."sv;
+		}
+
+		const auto last = a_path.find_last_not_of("/\\"sv);
+		a_path = a_path.substr(first, last - first + 1);
+		if (a_path.size() >= max_path) {
+			return "."sv;
+		}
+
+		for (std::size_t i = 0; i < a_path.size(); ++i) {
+			const auto ch = a_path[i];
+			if ('A' <= ch && ch <= 'Z') {
+				a_buffer[i] = static_cast<char>(ch + ('a' - 'A'));
+			} else if (ch == '/') {
+				a_buffer[i] = '\\';
+			} else {
+				a_buffer[i] = ch;
+			}
+		}
+
+		return { a_buffer.data(), a_path.size() };
+	}
+
+	// runs a_func over [0, a_count) with the given executor,
+	// rethrowing the first exception thrown by any task once every task has finished
+	void parallel_for(
+		const executor& a_executor,
+		std::size_t a_count,
+		const std::function<void(std::size_t)>& a_func);
+
+	// hashes a_paths into a_hashes using a_hash, handing out the paths to a_executor in chunks
+	template <class Hash, class Func>
+	void hash_batch(
+		std::span<const std::string_view> a_paths,
+		std::span<Hash> a_hashes,
+		const executor& a_executor,
+		Func a_hash)
+	{
+		assert(a_paths.size() == a_hashes.size());
+
+		constexpr std::size_t chunk = 1u << 10u;
+		const auto count = (std::min)(a_paths.size(), a_hashes.size());
+		parallel_for(
+			a_executor,
+			(count + chunk - 1) / chunk,
+			[&](std::size_t a_idx) {
+				const auto first = a_idx * chunk;
+				const auto last = (std::min)(first + chunk, count);
+				for (auto i = first; i < last; ++i) {
+					a_hashes[i] = a_hash(a_paths[i]);
+				}
+			});
+	}
+
+	// the limits on a single window of a pipeline
+	struct pipeline_window final
+	{
+		std::size_t budget{ 1u << 26u };  // the total cost of the items in a window
+		std::size_t max_items{ 1u << 12u };
+	};
+
+	// produces a_count items in bounded windows using a_executor, and consumes them in order on a
+	// single task, so that consuming one window overlaps with producing the next, and at most two
+	// windows are ever alive at once
+	template <class T, class Cost, class Produce, class Consume>
+	void pipeline(
+		const executor& a_executor,
+		std::size_t a_count,
+		Cost a_cost,
+		Produce a_produce,
+		Consume a_consume,
+		const pipeline_window& a_window = {})
+	{
+		std::vector<T> ready;
+		std::vector<T> pending;
+		std::size_t readyFirst = 0;
+		std::size_t next = 0;
+		while (next < a_count || !ready.empty()) {
+			// as many items as fit within the budget, but always at least one
+			auto last = next;
+			for (std::size_t cost = 0; last < a_count && last - next < a_window.max_items; ++last) {
+				cost += a_cost(last);
+				if (cost > a_window.budget && last != next) {
+					break;
+				}
+			}
+
+			// executors should start tasks in ascending order (see bsa::executor), so the consumer
+			// takes the first index to ensure it starts right away, instead of only once every
+			// producer has been claimed
+			const auto produced = last - next;
+			const std::size_t consumers = ready.empty() ? 0 : 1;
+			pending.clear();
+			pending.resize(produced);
+			parallel_for(
+				a_executor,
+				consumers + produced,
+				[&](std::size_t a_idx) {
+					if (a_idx < consumers) {
+						for (std::size_t i = 0; i < ready.size(); ++i) {
+							a_consume(readyFirst + i, ready[i]);
+						}
+					} else {
+						const auto idx = a_idx - consumers;
+						pending[idx] = a_produce(next + idx);
+					}
+				});
+
+			ready.swap(pending);
+			readyFirst = next;
+			next = last;
+		}
+	}
+
+	// a read only mapping of a file on the native filesystem, which remembers where the file came
+	// from, so that a handle to it can be opened later on if the platform can copy byte ranges of
+	// it without going through userspace
+	class mapped_file final
+	{
+	public:
+		explicit mapped_file(const std::filesystem::path& a_path);
+
+		mapped_file(const mapped_file&) = delete;
+		mapped_file(mapped_file&&) = delete;
+
+		~mapped_file() noexcept = default;
+
+		mapped_file& operator=(const mapped_file&) = delete;
+		mapped_file& operator=(mapped_file&&) = delete;
+
+		[[nodiscard]] auto data() const noexcept -> const std::byte* { return _map.data(); }
+		[[nodiscard]] auto size() const noexcept -> std::size_t { return _map.size(); }
+
+		// opens a new handle to the mapped file, which must be passed to close_handle, or returns -1
+		// if the platform can't copy from it, or the file on disk is no longer the one that was mapped
+		[[nodiscard]] auto open_handle() const noexcept -> std::intptr_t;
+		static void close_handle(std::intptr_t a_handle) noexcept;
+
+	private:
+		mmio::mapped_file_source _map;
+		std::filesystem::path _path;
+		std::optional<std::pair<std::uint64_t, std::uint64_t>> _identity;  // device, inode
+	};
+
+	// a byte range of a mapped file
+	struct mapped_range final
+	{
+		const mapped_file* file{ nullptr };
+		std::span<const std::byte> bytes;
+	};
+
+	// a file on the native filesystem which is written to at explicit offsets, so that disjoint
+	// regions of it may be filled in concurrently
+	class positional_ostream final
+	{
+	public:
+		// creates (or truncates) the file at a_path, and preallocates it to a_size bytes
+		positional_ostream(
+			const std::filesystem::path& a_path,
+			std::size_t a_size);
+
+		positional_ostream(const positional_ostream&) = delete;
+		positional_ostream(positional_ostream&&) = delete;
+
+		~positional_ostream() noexcept;
+
+		positional_ostream& operator=(const positional_ostream&) = delete;
+		positional_ostream& operator=(positional_ostream&&) = delete;
+
+		// safe to call concurrently
+		void write_bytes(
+			std::size_t a_offset,
+			std::span<const std::byte> a_bytes) const;
+
+		// lets the kernel copy the range from a_source (a handle from mapped_file::open_handle) when
+		// it can, and falls back to writing it from the mapping otherwise, *not* safe to call
+		// concurrently
+		void copy_bytes(
+			std::size_t a_offset,
+			const mapped_range& a_range,
+			std::intptr_t a_source) const;
+
+	private:
+		std::intptr_t _handle{ -1 };
+	};
+
+	// writes the given ranges back to back into a new file at a_path
+	void write_mapped(
+		const std::filesystem::path& a_path,
+		std::span<const mapped_range> a_ranges);
+
 	[[nodiscard]] auto read_bstring(detail::istream_t& a_in) -> std::string_view;
 	[[nodiscard]] auto read_bzstring(detail::istream_t& a_in) -> std::string_view;
 	[[nodiscard]] auto read_wstring(detail::istream_t& a_in) -> std::string_view;
 	[[nodiscard]] auto read_zstring(detail::istream_t& a_in) -> std::string_view;
 
+	// splits up to a_count consecutive zstrings out of the stream, stopping early if the stream runs out
+	[[nodiscard]] auto read_zstrings(
+		detail::istream_t& a_in,
+		std::size_t a_count)
+		-> std::vector<std::string_view>;
+
 	template <class Enum>
 	[[nodiscard]] constexpr auto to_underlying(Enum a_val) noexcept
 		-> std::underlying_type_t<Enum>
@@ -354,16 +633,45 @@ namespace bsa::detail
 	}
 
 	void write_bzstring(detail::ostream_t& a_out, std::string_view a_string) noexcept;
+	void write_zeros(detail::ostream_t& a_out, std::size_t a_count) noexcept;
 	void write_wstring(detail::ostream_t& a_out, std::string_view a_string) noexcept;
 	void write_zstring(detail::ostream_t& a_out, std::string_view a_string) noexcept;
 
+	class string_arena final
+	{
+	public:
+		string_arena() noexcept = default;
+		string_arena(const string_arena&) = delete;
+		string_arena(string_arena&&) noexcept = default;
+
+		~string_arena() noexcept = default;
+
+		string_arena& operator=(const string_arena&) = delete;
+		string_arena& operator=(string_arena&&) noexcept = default;
+
+		[[nodiscard]] auto push(std::string_view a_string) -> std::string_view;
+
+		// the size of the next block to allocate, allocation is deferred until the first push
+		void size_hint(std::size_t a_size) noexcept { _hint = a_size; }
+
+	private:
+		static constexpr std::size_t block_size = 0x10000;
+
+		std::vector<std::unique_ptr<char[]>> _blocks;
+		char* _pos{ nullptr };
+		std::size_t _left{ 0 };
+		std::size_t _hint{ 0 };
+	};
+
 	class istream_t final
 	{
 	public:
 		using stream_type = binary_io::span_istream;
-		using file_type = mmio::mapped_file_source;
+		using file_type = mapped_file;
 
-		istream_t(std::filesystem::path a_path);
+		istream_t(
+			std::filesystem::path a_path,
+			map_ownership a_ownership = map_ownership::shared);
 		istream_t(std::span<const std::byte> a_bytes, copy_type a_copy) noexcept;
 
 		istream_t(const volatile istream_t&) = delete;
@@ -384,10 +692,82 @@ namespace bsa::detail
 		[[nodiscard]] bool has_file() const noexcept { return _file != nullptr; }
 		[[nodiscard]] bool shallow_copy() const noexcept { return _copy == copy_type::shallow; }
 
+		// the arena which deep copied names are stored in, shared by every key read from the stream
+		[[nodiscard]] auto names()
+			-> const std::shared_ptr<string_arena>&
+		{
+			if (!_names) {
+				_names = std::make_shared<string_arena>();
+			}
+			return _names;
+		}
+
+		// hands the mapping over to an archive, so entries read afterwards will only store views
+		[[nodiscard]] auto adopt_file() noexcept
+			-> std::shared_ptr<file_type>
+		{
+			return _ownership == map_ownership::archive ?
+			           std::move(_file) :
+			           nullptr;
+		}
+
 	private:
 		std::shared_ptr<file_type> _file;
+		std::shared_ptr<string_arena> _names;
 		stream_type _stream;
 		copy_type _copy{ copy_type::deep };
+		map_ownership _ownership{ map_ownership::shared };
+	};
+
+	// gathers writes into a contiguous buffer, and hands them to the type erased sink in large
+	// blocks, so that serializing a record doesn't dispatch through the sink for every field
+	class ostream_t final :
+		public binary_io::ostream_interface<ostream_t>
+	{
+	public:
+		using stream_type = binary_io::any_ostream;
+
+		explicit ostream_t(stream_type& a_stream) noexcept :
+			_stream(a_stream)
+		{}
+
+		ostream_t(const ostream_t&) = delete;
+		ostream_t& operator=(const ostream_t&) = delete;
+
+		// anything still buffered *must* be flushed before the stream is destroyed
+		~ostream_t() noexcept { assert(_size == 0 || std::uncaught_exceptions() > 0); }
+
+		void write_bytes(std::span<const std::byte> a_bytes)
+		{
+			if (a_bytes.size() > buffer_size - _size) {
+				this->flush();
+				if (a_bytes.size() >= buffer_size) {
+					_stream.write_bytes(a_bytes);
+					return;
+				}
+			}
+
+			if (!_buffer) {
+				_buffer = std::make_unique_for_overwrite<std::byte[]>(buffer_size);
+			}
+			std::memcpy(_buffer.get() + _size, a_bytes.data(), a_bytes.size());
+			_size += a_bytes.size();
+		}
+
+		void flush()
+		{
+			if (_size > 0) {
+				_stream.write_bytes({ _buffer.get(), _size });
+				_size = 0;
+			}
+		}
+
+	private:
+		static constexpr std::size_t buffer_size = 1u << 16u;
+
+		stream_type& _stream;
+		std::unique_ptr<std::byte[]> _buffer;
+		std::size_t _size{ 0 };
 	};
 
 	template <class T>
@@ -413,6 +793,271 @@ namespace bsa::detail
 		istream_t& _proxy;
 		std::size_t _pos;
 	};
+
+	// keys and values are stored in separate arrays, so that keys can be shifted around while
+	// only ever being handed out as const (modifying one would break the sort order), and so that
+	// lookups only touch the keys
+	template <class Key, class T>
+	class flat_map final
+	{
+	private:
+		template <bool CONST>
+		class basic_iterator;
+
+	public:
+		using key_type = Key;
+		using mapped_type = T;
+		using value_type = std::pair<const key_type, mapped_type>;
+		using key_compare = std::less<>;
+		using iterator = basic_iterator<false>;
+		using const_iterator = basic_iterator<true>;
+
+		[[nodiscard]] bool empty() const noexcept { return _keys.empty(); }
+		[[nodiscard]] std::size_t size() const noexcept { return _keys.size(); }
+
+		[[nodiscard]] iterator begin() noexcept { return this->at(0); }
+		[[nodiscard]] const_iterator begin() const noexcept { return this->at(0); }
+		[[nodiscard]] const_iterator cbegin() const noexcept { return this->begin(); }
+
+		[[nodiscard]] iterator end() noexcept { return this->at(this->size()); }
+		[[nodiscard]] const_iterator end() const noexcept { return this->at(this->size()); }
+		[[nodiscard]] const_iterator cend() const noexcept { return this->end(); }
+
+		template <class K>
+		[[nodiscard]] iterator find(const K& a_key) noexcept
+		{
+			const auto pos = this->lower_bound(a_key);
+			return this->at(pos != this->size() && _keys[pos] == a_key ? pos : this->size());
+		}
+
+		template <class K>
+		[[nodiscard]] const_iterator find(const K& a_key) const noexcept
+		{
+			return const_cast<flat_map&>(*this).find(a_key);
+		}
+
+		void clear() noexcept
+		{
+			_keys.clear();
+			_values.clear();
+		}
+
+		template <class K, class... Args>
+		std::pair<iterator, bool> emplace(K&& a_key, Args&&... a_args)
+		{
+			// keys read from disk are usually already sorted, so appending is the fast path
+			const auto pos =
+				_keys.empty() || _keys.back() < a_key ?
+					this->size() :
+					this->lower_bound(a_key);
+			if (pos != this->size() && _keys[pos] == a_key) {
+				return { this->at(pos), false };
+			}
+
+			_keys.emplace(_keys.begin() + pos, std::forward<K>(a_key));
+			try {
+				_values.emplace(_values.begin() + pos, std::forward<Args>(a_args)...);
+			} catch (...) {
+				_keys.erase(_keys.begin() + pos);
+				throw;
+			}
+			return { this->at(pos), true };
+		}
+
+		// the mapped value is only constructed if the key is inserted
+		template <class... Args>
+		std::pair<iterator, bool> try_emplace(key_type&& a_key, Args&&... a_args)
+		{
+			return this->emplace(std::move(a_key), std::forward<Args>(a_args)...);
+		}
+
+		iterator erase(const_iterator a_pos) noexcept
+		{
+			const auto pos = static_cast<std::size_t>(a_pos._key - _keys.cbegin());
+			_keys.erase(_keys.begin() + pos);
+			_values.erase(_values.begin() + pos);
+			return this->at(pos);
+		}
+
+		// adopts a_values, which must be sorted by key, keeping only the first of any duplicate keys
+		void assign_sorted(std::vector<std::pair<key_type, mapped_type>>&& a_values) noexcept
+		{
+			this->clear();
+			_keys.reserve(a_values.size());
+			_values.reserve(a_values.size());
+			for (auto& [key, value] : a_values) {
+				if (_keys.empty() || _keys.back() != key) {
+					_keys.push_back(std::move(key));
+					_values.push_back(std::move(value));
+				}
+			}
+			a_values.clear();
+		}
+
+	private:
+		// dereferences to a pair of references into the key and value arrays, just as
+		// std::flat_map does, so the key is const without ever aliasing a std::pair<const Key, T>
+		template <bool CONST>
+		class basic_iterator final
+		{
+		private:
+			using key_iterator = typename std::vector<key_type>::const_iterator;
+			using value_iterator = std::conditional_t<
+				CONST,
+				typename std::vector<mapped_type>::const_iterator,
+				typename std::vector<mapped_type>::iterator>;
+
+		public:
+			using iterator_concept = std::random_access_iterator_tag;
+			using iterator_category = std::input_iterator_tag;  // references are proxies
+			using value_type = flat_map::value_type;
+			using difference_type = std::ptrdiff_t;
+			using reference = std::pair<
+				const key_type&,
+				std::conditional_t<CONST, const mapped_type&, mapped_type&>>;
+
+			// holds the reference, so that members can be accessed through operator->
+			class pointer final
+			{
+			public:
+				[[nodiscard]] const reference* operator->() const noexcept { return std::addressof(_ref); }
+
+			private:
+				friend basic_iterator;
+
+				explicit pointer(reference a_ref) noexcept :
+					_ref(a_ref)
+				{}
+
+				reference _ref;
+			};
+
+			basic_iterator() noexcept = default;
+
+			template <bool C = CONST>
+			basic_iterator(const basic_iterator<false>& a_rhs) noexcept  //
+				requires(C)
+				:
+				_key(a_rhs._key),
+				_value(a_rhs._value)
+			{}
+
+			[[nodiscard]] reference operator*() const noexcept { return { *_key, *_value }; }
+			[[nodiscard]] pointer operator->() const noexcept { return pointer{ **this }; }
+			[[nodiscard]] reference operator[](difference_type a_n) const noexcept { return *(*this + a_n); }
+
+			basic_iterator& operator++() noexcept { return *this += 1; }
+			basic_iterator operator++(int) noexcept
+			{
+				auto result = *this;
+				++*this;
+				return result;
+			}
+
+			basic_iterator& operator--() noexcept { return *this -= 1; }
+			basic_iterator operator--(int) noexcept
+			{
+				auto result = *this;
+				--*this;
+				return result;
+			}
+
+			basic_iterator& operator+=(difference_type a_n) noexcept
+			{
+				_key += a_n;
+				_value += a_n;
+				return *this;
+			}
+
+			basic_iterator& operator-=(difference_type a_n) noexcept { return *this += -a_n; }
+
+			[[nodiscard]] friend basic_iterator operator+(basic_iterator a_lhs, difference_type a_rhs) noexcept { return a_lhs += a_rhs; }
+			[[nodiscard]] friend basic_iterator operator+(difference_type a_lhs, basic_iterator a_rhs) noexcept { return a_rhs += a_lhs; }
+			[[nodiscard]] friend basic_iterator operator-(basic_iterator a_lhs, difference_type a_rhs) noexcept { return a_lhs -= a_rhs; }
+
+			[[nodiscard]] friend difference_type operator-(
+				const basic_iterator& a_lhs,
+				const basic_iterator& a_rhs) noexcept
+			{
+				return a_lhs._key - a_rhs._key;
+			}
+
+			[[nodiscard]] friend bool operator==(
+				const basic_iterator& a_lhs,
+				const basic_iterator& a_rhs) noexcept
+			{
+				return a_lhs._key == a_rhs._key;
+			}
+
+			[[nodiscard]] friend auto operator<=>(
+				const basic_iterator& a_lhs,
+				const basic_iterator& a_rhs) noexcept
+			{
+				return a_lhs._key <=> a_rhs._key;
+			}
+
+		private:
+			friend flat_map;
+			friend basic_iterator<!CONST>;
+
+			basic_iterator(key_iterator a_key, value_iterator a_value) noexcept :
+				_key(a_key),
+				_value(a_value)
+			{}
+
+			key_iterator _key{};
+			value_iterator _value{};
+		};
+
+		[[nodiscard]] iterator at(std::size_t a_pos) noexcept
+		{
+			const auto n = static_cast<std::ptrdiff_t>(a_pos);
+			return { _keys.cbegin() + n, _values.begin() + n };
+		}
+
+		[[nodiscard]] const_iterator at(std::size_t a_pos) const noexcept
+		{
+			const auto n = static_cast<std::ptrdiff_t>(a_pos);
+			return { _keys.cbegin() + n, _values.cbegin() + n };
+		}
+
+		template <class K>
+		[[nodiscard]] auto lower_bound(const K& a_key) const noexcept
+			-> std::size_t
+		{
+			const auto it = std::lower_bound(
+				_keys.begin(),
+				_keys.end(),
+				a_key,
+				[](const key_type& a_lhs, const K& a_rhs) noexcept {
+					return a_lhs < a_rhs;
+				});
+			return static_cast<std::size_t>(it - _keys.begin());
+		}
+
+		std::vector<key_type> _keys;
+		std::vector<mapped_type> _values;
+	};
+
+	template <class Key, class T>
+	void assign_sorted(
+		flat_map<Key, T>& a_map,
+		std::vector<std::pair<Key, T>>&& a_values) noexcept
+	{
+		a_map.assign_sorted(std::move(a_values));
+	}
+
+	template <class Key, class T>
+	void assign_sorted(
+		std::map<Key, T, std::less<>>& a_map,
+		std::vector<std::pair<Key, T>>&& a_values) noexcept
+	{
+		// every element is inserted at the end, so each insertion is amortized constant
+		a_map.clear();
+		for (auto& [key, value] : a_values) {
+			a_map.emplace_hint(a_map.end(), std::move(key), std::move(value));
+		}
+	}
 }
 #endif
 
@@ -518,7 +1163,18 @@ namespace bsa
 		///
 		/// \exception	std::system_error	Thrown when filesystem errors are encountered.
 		read_source(std::filesystem::path a_path) :
-			_value(std::move(a_path))
+			read_source(std::move(a_path), map_ownership::shared)
+		{}
+
+		/// \param	a_path	The path to read from on the native filesystem.
+		/// \param	a_ownership	Who owns the mapping of the file.
+		///
+		/// \exception	std::system_error	Thrown when filesystem errors are encountered.
+		///
+		/// \remark	\ref map_ownership::archive "Archive" ownership only applies when reading
+		///		archives. Files read on their own always share ownership of their mapping.
+		read_source(std::filesystem::path a_path, map_ownership a_ownership) :
+			_value(std::move(a_path), a_ownership)
 		{}
 
 		/// \param	a_src	The source to read from.
@@ -557,9 +1213,11 @@ namespace bsa
 	public:
 		/// \param a_path The path to write to on the native filesystem.
 		///
-		/// \exception	std::system_error	Thrown when filesystem errors are encountered.
-		write_sink(std::filesystem::path a_path) :
-			_value(std::in_place_index<stream_value>, std::in_place_type<binary_io::file_ostream>, std::move(a_path))
+		/// \remark	The file is only created once something is written to it, and
+		///		`std::system_error` is thrown from the write when filesystem errors are
+		///		encountered.
+		write_sink(std::filesystem::path a_path) noexcept :
+			_value(std::in_place_index<stream_path>, std::move(a_path))
 		{}
 
 		/// \param	a_dst	The stream to write the archive to.
@@ -582,17 +1240,32 @@ namespace bsa
 		{
 			stream_value,
 			stream_reference,
+			stream_path,
 
 			stream_count
 		};
 
-		[[nodiscard]] auto stream() noexcept -> value_type&
+		// the file to write to, if the sink is backed by one which hasn't been opened yet
+		[[nodiscard]] auto path() const noexcept -> const std::filesystem::path*
+		{
+			return std::get_if<stream_path>(&_value);
+		}
+
+		[[nodiscard]] auto stream() -> value_type&
 		{
 			switch (_value.index()) {
 			case stream_value:
 				return *std::get_if<stream_value>(&_value);
 			case stream_reference:
 				return *std::get_if<stream_reference>(&_value);
+			case stream_path:
+				{
+					value_type stream{
+						std::in_place_type<binary_io::file_ostream>,
+						std::move(*std::get_if<stream_path>(&_value))
+					};
+					return _value.emplace<stream_value>(std::move(stream));
+				}
 			default:
 				detail::declare_unreachable();
 			}
@@ -600,7 +1273,8 @@ namespace bsa
 
 		std::variant<
 			value_type,
-			std::reference_wrapper<value_type>>
+			std::reference_wrapper<value_type>,
+			std::filesystem::path>
 			_value;
 
 		static_assert(stream_count == std::variant_size_v<decltype(_value)>);
@@ -636,10 +1310,12 @@ namespace bsa::components
 		/// @{
 
 		/// \brief	Checks if the underlying byte container is empty.
-		[[nodiscard]] bool empty() const noexcept { return size() == 0; }
+		/// \exception	binary_io::buffer_exhausted	Thrown when a record read lazily is malformed.
+		[[nodiscard]] bool empty() const { return size() == 0; }
 
 		/// \brief	Returns the size of the underlying byte container.
-		[[nodiscard]] std::size_t size() const noexcept { return as_bytes().size(); }
+		/// \exception	binary_io::buffer_exhausted	Thrown when a record read lazily is malformed.
+		[[nodiscard]] std::size_t size() const { return as_bytes().size(); }
 
 		/// @}
 
@@ -662,13 +1338,22 @@ namespace bsa::components
 		/// @{
 
 		/// \brief	Retrieves an immutable view into the underlying bytes.
-		std::span<const std::byte> as_bytes() const noexcept;
+		/// \exception	binary_io::buffer_exhausted	Thrown when a record read lazily is malformed,
+		///		i.e. its embedded name runs past the end of the record.
+		std::span<const std::byte> as_bytes() const;
 
 		/// \brief	Retrieves an immutable pointer to the underlying bytes.
-		[[nodiscard]] const std::byte* data() const noexcept { return as_bytes().data(); }
+		/// \exception	binary_io::buffer_exhausted	Thrown when a record read lazily is malformed.
+		[[nodiscard]] const std::byte* data() const { return as_bytes().data(); }
 
 		/// @}
 
+#ifndef DOXYGEN
+	protected:
+		// the underlying bytes as a range of the file they're mapped from, if that file is known
+		[[nodiscard]] auto mapped_range() const -> std::optional<detail::mapped_range>;
+#endif
+
 	private:
 		friend compressed_byte_container;
 		friend byte_container;
@@ -678,16 +1363,29 @@ namespace bsa::components
 			data_view,
 			data_owner,
 			data_proxied,
+			data_deferred,
 
 			data_count
 		};
 
 		using data_proxy = detail::istream_proxy<std::span<const std::byte>>;
 
+		// a record exactly as it appears on disk, whose prefixes are only parsed on access
+		struct deferred_t final
+		{
+			std::span<const std::byte> raw;
+			bool name_prefix{ false };  // a bstring
+			bool size_prefix{ false };  // a little endian std::uint32_t
+			std::shared_ptr<detail::istream_t::file_type> f;
+		};
+
+		[[nodiscard]] auto deferred_decompressed_size() const -> std::optional<std::size_t>;
+
 		std::variant<
 			std::span<const std::byte>,
 			std::vector<std::byte>,
-			data_proxy>
+			data_proxy,
+			deferred_t>
 			_data;
 
 		static_assert(data_count == std::variant_size_v<decltype(_data)>);
@@ -750,10 +1448,11 @@ namespace bsa::components
 
 		/// \brief	Retrieves the decompressed size of the compressed storage.
 		/// \details	Only valid if the container *is* compressed.
-		[[nodiscard]] std::size_t decompressed_size() const noexcept
+		/// \exception	binary_io::buffer_exhausted	Thrown when a record read lazily is malformed.
+		[[nodiscard]] std::size_t decompressed_size() const
 		{
 			assert(this->compressed());
-			return *_decompsz;
+			return _decompsz ? *_decompsz : *this->deferred_decompressed_size();
 		}
 
 		/// @}
@@ -791,7 +1490,15 @@ namespace bsa::components
 		/// @{
 
 		/// \brief	Checks if the underlying bytes are compressed.
-		[[nodiscard]] bool compressed() const noexcept { return _decompsz.has_value(); }
+		[[nodiscard]] bool compressed() const noexcept
+		{
+			if (_decompsz) {
+				return true;
+			} else {
+				const auto deferred = std::get_if<data_deferred>(&_data);
+				return deferred && deferred->size_prefix;
+			}
+		}
 
 		/// @}
 
@@ -819,23 +1526,64 @@ namespace bsa::components
 			}
 			_decompsz = a_decompressedSize;
 		}
+
+		void set_data_deferred(
+			std::span<const std::byte> a_raw,
+			const detail::istream_t& a_in,
+			bool a_namePrefix,
+			bool a_sizePrefix) noexcept
+		{
+			assert(a_in.shallow_copy());
+			detail::variant_emplace<data_deferred>(_data, a_raw, a_namePrefix, a_sizePrefix, a_in.file());
+			_decompsz.reset();
+		}
 #endif
 
 	private:
 		std::optional<std::size_t> _decompsz;
 	};
 
+	/// \brief	Backs a \ref hashmap with a node based, balanced tree.
+	/// \details	Insertion and erasure are logarithmic regardless of the order keys arrive in,
+	///		and iterators remain valid until the element they refer to is erased. This is the
+	///		default storage for every archive type.
+	struct tree_storage final
+	{
+#ifndef DOXYGEN
+		template <class Key, class T>
+		using container_type = std::map<Key, T, std::less<>>;
+#endif
+	};
+
+	/// \brief	Backs a \ref hashmap with a single contiguous array, kept sorted by hash.
+	/// \details	Lookups are a binary search over contiguous memory, iteration is a linear
+	///		scan, and destruction releases a single allocation. Insertion is amortized constant
+	///		when keys arrive in ascending order (as they do when reading most archives), but
+	///		is linear otherwise. Any insertion or erasure invalidates iterators and references.
+	/// \remark	Just as with `std::flat_map`, keys and values are stored apart, so iterators
+	///		dereference to a `std::pair` of references rather than a reference to a `value_type`.
+	///		Elements must be bound with `auto&&` or `const auto&`, rather than `auto&`.
+	struct flat_storage final
+	{
+#ifndef DOXYGEN
+		template <class Key, class T>
+		using container_type = detail::flat_map<Key, T>;
+#endif
+	};
+
 	/// \brief	Establishes a basic mapping between a \ref key and its
 	///		associated files.
+	/// \details	Elements are always iterated in ascending order of their hash.
 	///
 	/// \tparam	T	The `mapped_type`.
 	/// \tparam	RECURSE	Determines if indexing via `operator[]` is a recursive action.
-	template <class T, bool RECURSE>
+	/// \tparam	Storage	The backing store, either \ref tree_storage or \ref flat_storage.
+	template <class T, bool RECURSE, class Storage>
 	class hashmap
 	{
 	private:
 		using container_type =
-			std::map<typename T::key, T>;
+			typename Storage::template container_type<typename T::key, T>;
 
 	public:
 		/// \name Member types
@@ -850,6 +1598,7 @@ namespace bsa::components
 		using mapped_type = typename container_type::mapped_type;
 		using value_type = typename container_type::value_type;
 #endif
+		using hash_type = typename key_type::hash_type;
 		using key_compare = typename container_type::key_compare;
 		using iterator = typename container_type::iterator;
 		using const_iterator = typename container_type::const_iterator;
@@ -993,24 +1742,72 @@ namespace bsa::components
 
 		/// \brief	Obtains a proxy to the underlying `mapped_type`. The validity of the
 		///		proxy depends on the presence of the key within the container.
-		[[nodiscard]] index operator[](const key_type& a_key) noexcept
+		[[nodiscard]] index operator[](const key_type& a_key) noexcept { return (*this)[a_key.hash()]; }
+
+		/// \copybrief operator[]()
+		[[nodiscard]] const_index operator[](const key_type& a_key) const noexcept { return (*this)[a_key.hash()]; }
+
+		/// \copybrief operator[]()
+		/// \remark	Looks up the element by its raw hash, without constructing a key.
+		[[nodiscard]] index operator[](const hash_type& a_hash) noexcept
 		{
-			const auto it = _map.find(a_key);
+			const auto it = _map.find(a_hash);
 			return it != _map.end() ? index{ it->second } : index{};
 		}
 
-		/// \copybrief operator[]()
-		[[nodiscard]] const_index operator[](const key_type& a_key) const noexcept
+		/// \copydoc operator[](const hash_type&)
+		[[nodiscard]] const_index operator[](const hash_type& a_hash) const noexcept
 		{
-			const auto it = _map.find(a_key);
+			const auto it = _map.find(a_hash);
 			return it != _map.end() ? const_index{ it->second } : const_index{};
 		}
 
+		/// \copybrief operator[]()
+		/// \remark	The string is hashed without constructing a key, so no allocations are made.
+		template <class String>
+		[[nodiscard]] index operator[](const String& a_string) noexcept  //
+			requires(std::convertible_to<const String&, std::string_view>)
+		{
+			return (*this)[key_type::hash_string(a_string)];
+		}
+
+		/// \copydoc operator[](const String&)
+		template <class String>
+		[[nodiscard]] const_index operator[](const String& a_string) const noexcept  //
+			requires(std::convertible_to<const String&, std::string_view>)
+		{
+			return (*this)[key_type::hash_string(a_string)];
+		}
+
 		/// \brief	Finds a `value_type` with the given key within the container.
-		[[nodiscard]] iterator find(const key_type& a_key) noexcept { return _map.find(a_key); }
+		[[nodiscard]] iterator find(const key_type& a_key) noexcept { return _map.find(a_key.hash()); }
+
+		/// \copybrief find()
+		[[nodiscard]] const_iterator find(const key_type& a_key) const noexcept { return _map.find(a_key.hash()); }
 
 		/// \copybrief find()
-		[[nodiscard]] const_iterator find(const key_type& a_key) const noexcept { return _map.find(a_key); }
+		/// \remark	Looks up the element by its raw hash, without constructing a key.
+		[[nodiscard]] iterator find(const hash_type& a_hash) noexcept { return _map.find(a_hash); }
+
+		/// \copydoc find(const hash_type&)
+		[[nodiscard]] const_iterator find(const hash_type& a_hash) const noexcept { return _map.find(a_hash); }
+
+		/// \copybrief find()
+		/// \remark	The string is hashed without constructing a key, so no allocations are made.
+		template <class String>
+		[[nodiscard]] iterator find(const String& a_string) noexcept  //
+			requires(std::convertible_to<const String&, std::string_view>)
+		{
+			return _map.find(key_type::hash_string(a_string));
+		}
+
+		/// \copydoc find(const String&)
+		template <class String>
+		[[nodiscard]] const_iterator find(const String& a_string) const noexcept  //
+			requires(std::convertible_to<const String&, std::string_view>)
+		{
+			return _map.find(key_type::hash_string(a_string));
+		}
 
 		/// @}
 
@@ -1020,9 +1817,13 @@ namespace bsa::components
 		/// \brief	Erases any element with the given key from the container.
 		///
 		/// \return	Returns `true` if the element was successfully deleted, `false` otherwise.
-		bool erase(const key_type& a_key) noexcept
+		bool erase(const key_type& a_key) noexcept { return this->erase(a_key.hash()); }
+
+		/// \copydoc erase()
+		/// \remark	Looks up the element by its raw hash, without constructing a key.
+		bool erase(const hash_type& a_hash) noexcept
 		{
-			const auto it = _map.find(a_key);
+			const auto it = _map.find(a_hash);
 			if (it != _map.end()) {
 				_map.erase(it);
 				return true;
@@ -1031,6 +1832,15 @@ namespace bsa::components
 			}
 		}
 
+		/// \copydoc erase()
+		/// \remark	The string is hashed without constructing a key, so no allocations are made.
+		template <class String>
+		bool erase(const String& a_string) noexcept  //
+			requires(std::convertible_to<const String&, std::string_view>)
+		{
+			return this->erase(key_type::hash_string(a_string));
+		}
+
 		/// \brief	Inserts `a_value` into the container with the given `a_key`.
 		///
 		/// \param	a_key	The key of the `value_type`.
@@ -1044,6 +1854,40 @@ namespace bsa::components
 			return _map.emplace(std::move(a_key), std::move(a_value));
 		}
 
+		/// \brief	Inserts a `mapped_type` constructed from `a_args` into the container with the
+		///		given `a_key`, if the key is not already present.
+		/// \details	Unlike a \ref find followed by an \ref insert, the key is only built and
+		///		hashed once. The `mapped_type` is only constructed if the insertion takes place.
+		///
+		/// \param	a_key	The key of the `value_type`.
+		/// \param	a_args	The arguments to construct the `mapped_type` from.
+		/// \return	Returns an `iterator` to the element with the given key, and a `bool` to
+		///		indicate if the insertion took place.
+		template <class... Args>
+		std::pair<iterator, bool> try_emplace(
+			key_type a_key,
+			Args&&... a_args) noexcept
+		{
+			return _map.try_emplace(std::move(a_key), std::forward<Args>(a_args)...);
+		}
+
+		/// \brief	Replaces the contents of the container with the given elements.
+		/// \details	Elements which are already in ascending order of their key are adopted in
+		///		linear time, otherwise they are sorted first. If several elements share a key, only
+		///		the first is kept, just as if they had been inserted one at a time.
+		///
+		/// \param	a_values	The elements to fill the container with.
+		void assign(std::vector<std::pair<key_type, mapped_type>> a_values) noexcept
+		{
+			const auto less = [](const auto& a_lhs, const auto& a_rhs) noexcept {
+				return a_lhs.first < a_rhs.first;
+			};
+			if (!std::is_sorted(a_values.begin(), a_values.end(), less)) {
+				std::stable_sort(a_values.begin(), a_values.end(), less);
+			}
+			detail::assign_sorted(_map, std::move(a_values));
+		}
+
 		/// @}
 
 #ifndef DOXYGEN
@@ -1059,7 +1903,8 @@ namespace bsa::components
 	///
 	/// \tparam	Hash	The hash type used as the underlying key.
 	/// \tparam	Hasher	The function used to generate the hash.
-	template <class Hash, hasher_t<Hash> Hasher>
+	/// \tparam	ViewHasher	The function used to generate the hash without making a copy of the string.
+	template <class Hash, hasher_t<Hash> Hasher, view_hasher_t<Hash> ViewHasher>
 	class key final
 	{
 	public:
@@ -1130,8 +1975,10 @@ namespace bsa::components
 		template <concepts::stringable String>
 		key(String&& a_string) noexcept
 		{
-			_name.emplace<name_owner>(std::forward<String>(a_string));
-			_hash = Hasher(*std::get_if<name_owner>(&_name));
+			auto owner = std::make_shared<std::string>(std::forward<String>(a_string));
+			_hash = Hasher(*owner);
+			const std::string_view name = *owner;
+			this->set_name(name, std::move(owner));
 		}
 
 		key(const key&) noexcept = default;
@@ -1152,20 +1999,17 @@ namespace bsa::components
 		/// \brief	Retrieve a reference to the underlying hash.
 		[[nodiscard]] const hash_type& hash() const noexcept { return _hash; }
 
+		/// \brief	Produces the hash a key constructed from `a_string` would have, without
+		///		constructing the key.
+		[[nodiscard]] static hash_type hash_string(std::string_view a_string) noexcept { return ViewHasher(a_string); }
+
 		/// \brief	Retrieve the name that generated the underlying hash.
-		[[nodiscard]] std::string_view name() const noexcept
-		{
-			switch (_name.index()) {
-			case name_view:
-				return *std::get_if<name_view>(&_name);
-			case name_owner:
-				return *std::get_if<name_owner>(&_name);
-			case name_proxied:
-				return std::get_if<name_proxied>(&_name)->d;
-			default:
-				detail::declare_unreachable();
-			}
-		}
+		/// \remark	The names of keys read from an archive live exactly as long as the entries
+		///		they were read with, i.e. for a \ref map_ownership::archive "mapping owned by the
+		///		archive", they are views into the archive, while otherwise they keep their storage
+		///		alive themselves. Names read from a shallow copied, in-memory buffer instead remain
+		///		views into that buffer.
+		[[nodiscard]] std::string_view name() const noexcept { return { _name, _length }; }
 
 		/// @}
 
@@ -1176,40 +2020,35 @@ namespace bsa::components
 		friend tes4::archive;
 #endif
 
-		enum : std::size_t
-		{
-			name_view,
-			name_owner,
-			name_proxied,
-
-			name_count
-		};
-
-		using name_proxy = detail::istream_proxy<std::string_view>;
-
 		key(hash_type a_hash,
 			std::string_view a_name,
-			const detail::istream_t& a_in) noexcept :
+			detail::istream_t& a_in) :
 			_hash(a_hash)
 		{
-			if (a_in.has_file() && a_in.shallow_copy()) {
-				_name.emplace<name_proxied>(a_name, a_in.file());
+			if (a_in.deep_copy()) {
+				// every name read from the stream shares one arena, instead of an allocation each
+				const auto& names = a_in.names();
+				this->set_name(names->push(a_name), names);
+			} else if (a_in.has_file()) {
+				this->set_name(a_name, a_in.file());
 			} else {
-				if (a_in.deep_copy()) {
-					_name.emplace<name_owner>(a_name);
-				} else {
-					_name.emplace<name_view>(a_name);
-				}
+				// either the caller's buffer, or a mapping the archive owns
+				this->set_name(a_name, nullptr);
 			}
 		}
 
-		hash_type _hash;
-		std::variant<
-			std::string_view,
-			std::string,
-			name_proxy>
-			_name;
+		void set_name(
+			std::string_view a_name,
+			std::shared_ptr<const void> a_owner) noexcept
+		{
+			_name = a_name.data();
+			_length = static_cast<std::uint32_t>(a_name.length());
+			_owner = std::move(a_owner);
+		}
 
-		static_assert(name_count == std::variant_size_v<decltype(_name)>);
+		hash_type _hash;
+		std::uint32_t _length{ 0 };
+		const char* _name{ nullptr };
+		std::shared_ptr<const void> _owner;  // keeps the name alive, unless it's only viewed
 	};
 }
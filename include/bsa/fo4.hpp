@@ -1,10 +1,13 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <compare>
 #include <cstddef>
 #include <cstdint>
 #include <filesystem>
+#include <memory>
 #include <optional>
 #include <span>
 #include <string>
@@ -23,6 +26,12 @@ namespace bsa::fo4
 	{
 		using namespace bsa::detail;
 
+#	ifdef BSA_FO4_FLAT_HASHMAP
+		using hashmap_storage = components::flat_storage;
+#	else
+		using hashmap_storage = components::tree_storage;
+#	endif
+
 		namespace constants
 		{
 			inline constexpr auto gnrl = make_four_cc("GNRL"sv);
@@ -130,13 +139,167 @@ namespace bsa::fo4
 		/// \copydoc bsa::tes3::hashing::hash_file_in_place()
 		[[nodiscard]] hash hash_file_in_place(std::string& a_path) noexcept;
 
+		/// \copydoc bsa::tes3::hashing::hash_file(std::string_view)
+		[[nodiscard]] hash hash_file(std::string_view a_path) noexcept;
+
 		/// \copydoc bsa::tes3::hashing::hash_file()
 		template <concepts::stringable String>
-		[[nodiscard]] hash hash_file(String&& a_path) noexcept
+		[[nodiscard]] hash hash_file(String&& a_path) noexcept  //
+			requires(!std::convertible_to<String, std::string_view>)
 		{
 			std::string str(std::forward<String>(a_path));
 			return hash_file_in_place(str);
 		}
+
+		/// \copydoc bsa::tes3::hashing::hash_files()
+		void hash_files(
+			std::span<const std::string_view> a_paths,
+			std::span<hash> a_hashes,
+			const executor& a_executor = default_executor());
+	}
+
+#ifndef DOXYGEN
+	namespace detail
+	{
+		struct split_t
+		{
+			std::string_view parent;
+			std::string_view stem;
+			std::string_view extension;
+		};
+
+		[[nodiscard]] constexpr auto split_path(std::string_view a_path) noexcept
+			-> split_t
+		{
+			const auto find = [&](char a_ch) noexcept {
+				const auto pos = a_path.find_last_of(a_ch);
+				return pos != std::string_view::npos ?
+				           std::optional{ pos } :
+				           std::nullopt;
+			};
+
+			split_t result;
+			const auto pstem = find('\\');
+			const auto pextension = find('.');
+
+			if (pstem) {
+				result.parent = a_path.substr(0, *pstem);
+			}
+
+			if (pextension) {
+				result.extension = a_path.substr(*pextension + 1);  // don't include '.'
+			}
+
+			const auto first = pstem ? *pstem + 1 : 0;
+			const auto last = pextension ?
+			                      *pextension - first :
+			                      pextension.value_or(std::string_view::npos);
+			result.stem = a_path.substr(first, last);
+
+			return result;
+		}
+
+		// tables for slicing-by-8, where crc_tables[0] is the classic byte at a time table
+		inline constexpr auto crc_tables = []() noexcept {
+			std::array<std::array<std::uint32_t, 256>, 8> tables{};
+			for (std::uint32_t i = 0; i < 256; ++i) {
+				auto crc = i;
+				for (std::size_t j = 0; j < 8; ++j) {
+					crc = (crc >> 1u) ^ (crc & 1u ? 0xEDB88320u : 0u);
+				}
+				tables[0][i] = crc;
+			}
+
+			for (std::size_t i = 1; i < tables.size(); ++i) {
+				for (std::size_t j = 0; j < 256; ++j) {
+					const auto prev = tables[i - 1][j];
+					tables[i][j] = (prev >> 8u) ^ tables[0][prev & 0xFFu];
+				}
+			}
+
+			return tables;
+		}();
+
+		static_assert(crc_tables[0][0x01] == 0x77073096);
+		static_assert(crc_tables[0][0x80] == 0xEDB88320);
+		static_assert(crc_tables[0][0xFF] == 0x2D02EF8D);
+
+		[[nodiscard]] constexpr auto load_le32(const char* a_src) noexcept
+			-> std::uint32_t
+		{
+			return std::uint32_t{ static_cast<unsigned char>(a_src[0]) } |
+			       std::uint32_t{ static_cast<unsigned char>(a_src[1]) } << 8u |
+			       std::uint32_t{ static_cast<unsigned char>(a_src[2]) } << 16u |
+			       std::uint32_t{ static_cast<unsigned char>(a_src[3]) } << 24u;
+		}
+
+		[[nodiscard]] constexpr auto crc32(std::string_view a_string) noexcept
+			-> std::uint32_t
+		{
+			const auto& t = crc_tables;
+			std::uint32_t result = 0;
+			auto data = a_string.data();
+			auto len = a_string.length();
+
+			for (; len >= 8; data += 8, len -= 8) {
+				const auto lo = load_le32(data) ^ result;
+				const auto hi = load_le32(data + 4);
+				result =
+					t[7][lo & 0xFFu] ^
+					t[6][(lo >> 8u) & 0xFFu] ^
+					t[5][(lo >> 16u) & 0xFFu] ^
+					t[4][lo >> 24u] ^
+					t[3][hi & 0xFFu] ^
+					t[2][(hi >> 8u) & 0xFFu] ^
+					t[1][(hi >> 16u) & 0xFFu] ^
+					t[0][hi >> 24u];
+			}
+
+			for (; len > 0; ++data, --len) {
+				result = (result >> 8u) ^ t[0][(result ^ static_cast<unsigned char>(*data)) & 0xFFu];
+			}
+
+			return result;
+		}
+
+		// hashes a path which has already been normalized
+		[[nodiscard]] constexpr auto hash_normalized(std::string_view a_path) noexcept
+			-> hashing::hash
+		{
+			const auto pieces = split_path(a_path);
+
+			hashing::hash h;
+			h.directory = crc32(pieces.parent);
+			h.file = crc32(pieces.stem);
+
+			const auto len = std::min<std::size_t>(pieces.extension.length(), 4u);
+			for (std::size_t i = 0; i < len; ++i) {
+				h.extension |=
+					std::uint32_t{ static_cast<unsigned char>(pieces.extension[i]) }
+					<< i * 8u;
+			}
+
+			return h;
+		}
+	}
+#endif
+
+	namespace hashing
+	{
+		/// \copydoc bsa::tes3::hashing::literals
+		namespace literals
+		{
+			/// \brief	Produces a hash for the given file path at compile time.
+			/// \remark	Equivalent to \ref bsa::fo4::hashing::hash_file.
+			[[nodiscard]] consteval hash operator""_file_hash(
+				const char* a_path,
+				std::size_t a_length) noexcept
+			{
+				std::array<char, detail::max_path> buffer{};
+				return detail::hash_normalized(
+					detail::normalize_path_constexpr({ a_path, a_length }, buffer));
+			}
+		}
 	}
 
 	/// \brief	Represents a chunk of a file within the FO4 virtual filesystem.
@@ -148,7 +311,9 @@ namespace bsa::fo4
 		friend file;
 		using super = components::compressed_byte_container;
 
-		[[nodiscard]] std::size_t compress_into_lz4(std::span<std::byte> a_out) const;
+		[[nodiscard]] std::size_t compress_into_lz4(
+			std::span<std::byte> a_out,
+			compression_preset a_preset) const;
 		[[nodiscard]] std::size_t compress_into_zlib(
 			std::span<std::byte> a_out,
 			int a_level,
@@ -184,6 +349,13 @@ namespace bsa::fo4
 		/// bsa::fo4::chunk::compression_params{
 		///		.compression_format_ = bsa::fo4::compression_format::lz4,
 		/// };
+		///
+		/// // Configure for FO4/FO76, favouring speed over size
+		/// bsa::fo4::chunk::compression_params{
+		///		.compression_format_ = bsa::fo4::compression_format::zip,
+		///		.compression_level_ = bsa::fo4::compression_level::fo4,
+		///		.compression_preset_ = bsa::compression_preset::fast,
+		/// };
 		/// \endcode
 		struct compression_params final
 		{
@@ -193,6 +365,12 @@ namespace bsa::fo4
 
 			/// \brief	The level to compress the data at.
 			compression_level compression_level_{ compression_level::fo4 };
+
+			/// \brief	The speed/ratio trade-off to compress with.
+			/// \remark	\ref compression_preset::normal "normal" keeps the level implied by
+			///		\ref compression_level_. The other presets only override the level itself, and
+			///		keep the rest of the profile.
+			compression_preset compression_preset_{ compression_preset::normal };
 		};
 
 		/// \brief	Unique to \ref format::directx.
@@ -347,6 +525,9 @@ namespace bsa::fo4
 			/// \brief	The level to compress the file at.
 			compression_level compression_level_{ compression_level::fo4 };
 
+			/// \brief	The speed/ratio trade-off to compress the file with.
+			compression_preset compression_preset_{ compression_preset::normal };
+
 			/// \brief	The resulting compression of the file read.
 			compression_type compression_type_{ compression_type::decompressed };
 		};
@@ -430,7 +611,7 @@ namespace bsa::fo4
 		using const_iterator = container_type::const_iterator;
 
 		/// \brief	The key used to indentify a file.
-		using key = components::key<hashing::hash, hashing::hash_file_in_place>;
+		using key = components::key<hashing::hash, hashing::hash_file_in_place, hashing::hash_file>;
 
 		/// @}
 
@@ -598,10 +779,10 @@ namespace bsa::fo4
 
 	/// \brief	Represents the FO4 revision of the ba2 format.
 	class archive final :
-		public components::hashmap<file>
+		public components::hashmap<file, false, detail::hashmap_storage>
 	{
 	private:
-		using super = components::hashmap<file>;
+		using super = components::hashmap<file, false, detail::hashmap_storage>;
 
 	public:
 		/// \brief	Archive info about the contents of the given archive.
@@ -656,12 +837,67 @@ namespace bsa::fo4
 		/// \name Modifiers
 		/// @{
 
-#ifdef DOXYGEN
 		/// \brief	Clears the contents of the archive.
-		void clear() noexcept;
-#else
-		using super::clear;
-#endif
+		void clear() noexcept
+		{
+			super::clear();
+			_file.reset();
+		}
+
+		/// @}
+
+		/// \name Compression
+		/// @{
+
+		/// \brief	Compresses every uncompressed chunk in the archive.
+		/// \details	Chunks are independent of each other, so they are compressed concurrently
+		///		using the given executor. Chunks which are already compressed are left untouched.
+		///		The result is identical to compressing each chunk one at a time.
+		///
+		/// \param	a_params	Extra configuration options.
+		/// \param	a_executor	The executor to run compression tasks on.
+		///
+		/// \exception	bsa::compression_error	Rethrown from the first chunk which failed to
+		///		compress, after every other chunk has finished.
+		void compress_all(
+			const chunk::compression_params& a_params,
+			const executor& a_executor = default_executor());
+
+		/// \brief	Compresses every chunk of the given files.
+		/// \copydetails	archive::compress_all
+		///
+		/// \param	a_files	The files to compress. Each file *must* appear at most once.
+		static void compress(
+			std::span<file* const> a_files,
+			const chunk::compression_params& a_params,
+			const executor& a_executor = default_executor());
+
+		/// @}
+
+		/// \name Decompression
+		/// @{
+
+		/// \brief	Decompresses every compressed chunk in the archive.
+		/// \details	Chunks are independent of each other, so they are decompressed concurrently
+		///		using the given executor. Chunks which are not compressed are left untouched.
+		///
+		/// \param	a_format	The format the data is currently compressed in.
+		/// \param	a_executor	The executor to run decompression tasks on.
+		///
+		/// \exception	bsa::compression_error	Rethrown from the first chunk which failed to
+		///		decompress, after every other chunk has finished.
+		void decompress_all(
+			compression_format a_format,
+			const executor& a_executor = default_executor());
+
+		/// \brief	Decompresses every chunk of the given files.
+		/// \copydetails	archive::decompress_all
+		///
+		/// \param	a_files	The files to decompress. Each file *must* appear at most once.
+		static void decompress(
+			std::span<file* const> a_files,
+			compression_format a_format,
+			const executor& a_executor = default_executor());
 
 		/// @}
 
@@ -685,9 +921,50 @@ namespace bsa::fo4
 			write_sink a_sink,
 			const meta_info& a_meta) const;
 
+		/// \copybrief bsa::tes4::archive::write(const std::filesystem::path&,version,const executor&) const
+		/// \details	Every offset within the archive is known before anything is written, so the
+		///		output is preallocated, and the data of each chunk is written to its own region of
+		///		it using the given executor. The header and tables are written last. The result is
+		///		identical to \ref write.
+		///
+		/// \param	a_path	The path to write to on the native filesystem.
+		/// \param	a_meta	Configuration options for how the archive is written.
+		/// \param	a_executor	The executor to run write tasks on.
+		///
+		/// \exception	std::system_error	Thrown when filesystem errors are encountered.
+		void write(
+			const std::filesystem::path& a_path,
+			const meta_info& a_meta,
+			const executor& a_executor) const;
+
+		/// \copybrief bsa::tes4::archive::write(write_sink,version,const file::compression_params&,const executor&) const
+		/// \details	The result is identical to calling \ref compress_all and then \ref write,
+		///		except that the archive itself is left untouched, and only a bounded window of
+		///		compressed chunks is ever held in memory. Chunks which are already compressed are
+		///		written as they are. Chunks are compressed using the given executor, while the
+		///		previous window of chunks is written out.
+		///
+		/// \remark	Space for the record tables is reserved up front, and they are filled in once
+		///		every chunk has been written, so the sink must support seeking.
+		///
+		/// \param	a_sink	Where/how to write the given archive.
+		/// \param	a_meta	Configuration options for how the archive is written.
+		/// \param	a_params	Extra configuration options for compression.
+		/// \param	a_executor	The executor to run compression tasks on.
+		///
+		/// \exception	bsa::compression_error	Rethrown from the first chunk which failed to
+		///		compress.
+		void write(
+			write_sink a_sink,
+			const meta_info& a_meta,
+			const chunk::compression_params& a_params,
+			const executor& a_executor = default_executor()) const;
+
 		/// @}
 
 	private:
+		struct chunk_record_t;
+
 		[[nodiscard]] auto make_header(const meta_info& a_meta) const
 			-> std::pair<detail::header_t, std::uint64_t>;
 
@@ -703,14 +980,25 @@ namespace bsa::fo4
 
 		void write_chunk(
 			const chunk& a_chunk,
+			const chunk_record_t& a_record,
 			detail::ostream_t& a_out,
 			format a_format,
 			std::uint64_t& a_dataOffset) const noexcept;
 
 		void write_file(
 			const file& a_file,
+			std::span<const chunk_record_t> a_records,
 			detail::ostream_t& a_out,
 			format a_format,
 			std::uint64_t& a_dataOffset) const noexcept;
+
+		// records are read from the chunks themselves if none are given
+		void write_file_entries(
+			std::span<const chunk_record_t> a_records,
+			detail::ostream_t& a_out,
+			format a_format,
+			std::uint64_t a_dataOffset) const noexcept;
+
+		std::shared_ptr<detail::istream_t::file_type> _file;
 	};
 }
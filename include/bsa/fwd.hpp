@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cstdint>
+#include <string>
+#include <string_view>
 
 namespace bsa
 {
@@ -21,13 +23,19 @@ namespace bsa
 		class byte_container;
 		class compressed_byte_container;
 
-		template <class, bool = false>
+		struct flat_storage;
+		struct tree_storage;
+
+		template <class, bool = false, class = tree_storage>
 		class hashmap;
 
 		template <class Hash>
 		using hasher_t = Hash (*)(std::string&) noexcept;
 
-		template <class Hash, hasher_t<Hash>>
+		template <class Hash>
+		using view_hasher_t = Hash (*)(std::string_view) noexcept;
+
+		template <class Hash, hasher_t<Hash>, view_hasher_t<Hash>>
 		class key;
 	}
 
@@ -90,12 +98,15 @@ namespace bsa
 
 		enum class archive_flag : std::uint32_t;
 		enum class archive_type : std::uint16_t;
+		enum class read_mode;
 		enum class version : std::uint32_t;
 	}
 
 	class exception;
 
 	enum class copy_type;
+	enum class compression_preset;
 	enum class compression_type;
 	enum class file_format;
+	enum class map_ownership;
 }
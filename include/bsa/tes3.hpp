@@ -1,11 +1,15 @@
 #pragma once
 
+#include <array>
+#include <bit>
 #include <compare>
 #include <cstddef>
 #include <cstdint>
 #include <filesystem>
+#include <memory>
 #include <span>
 #include <string>
+#include <string_view>
 #include <utility>
 
 #include <binary_io/any_stream.hpp>
@@ -18,6 +22,12 @@ namespace bsa::tes3
 	namespace detail
 	{
 		using namespace bsa::detail;
+
+#	ifdef BSA_TES3_FLAT_HASHMAP
+		using hashmap_storage = components::flat_storage;
+#	else
+		using hashmap_storage = components::tree_storage;
+#	endif
 	}
 #endif
 
@@ -35,7 +45,7 @@ namespace bsa::tes3
 
 			[[nodiscard]] friend bool operator==(const hash&, const hash&) noexcept = default;
 
-			[[nodiscard]] friend std::strong_ordering operator<=>(
+			[[nodiscard]] friend constexpr std::strong_ordering operator<=>(
 				const hash& a_lhs,
 				const hash& a_rhs) noexcept
 			{
@@ -48,7 +58,7 @@ namespace bsa::tes3
 			/// @{
 
 			/// \brief	Obtains the numeric value of the hash used for comparisons.
-			[[nodiscard]] std::uint64_t numeric() const noexcept
+			[[nodiscard]] constexpr std::uint64_t numeric() const noexcept
 			{
 				return std::uint64_t{
 					std::uint64_t{ hi } << 0u * 8u |
@@ -76,14 +86,81 @@ namespace bsa::tes3
 		///		the path contains the string that would be stored on disk.
 		[[nodiscard]] hash hash_file_in_place(std::string& a_path) noexcept;
 
+		/// \copybrief	hash_file_in_place()
+		/// \remark	The path is normalized into a buffer on the stack, so no allocations are made.
+		[[nodiscard]] hash hash_file(std::string_view a_path) noexcept;
+
 		/// \copybrief	hash_file_in_place()
 		/// \remark	See also \ref bsa::concepts::stringable.
 		template <concepts::stringable String>
-		[[nodiscard]] hash hash_file(String&& a_path) noexcept
+		[[nodiscard]] hash hash_file(String&& a_path) noexcept  //
+			requires(!std::convertible_to<String, std::string_view>)
 		{
 			std::string str(std::forward<String>(a_path));
 			return hash_file_in_place(str);
 		}
+
+		/// \brief	Produces hashes for many paths at once.
+		/// \details	Paths are split into chunks, which are hashed using the given executor.
+		///		`a_hashes[i]` receives the hash of `a_paths[i]`.
+		/// \pre	`a_paths.size()` *must* equal `a_hashes.size()`.
+		///
+		/// \param	a_paths	The paths to hash.
+		/// \param	a_hashes	The hashes to write to.
+		/// \param	a_executor	The executor to run hashing tasks on.
+		void hash_files(
+			std::span<const std::string_view> a_paths,
+			std::span<hash> a_hashes,
+			const executor& a_executor = default_executor());
+	}
+
+#ifndef DOXYGEN
+	namespace detail
+	{
+		// hashes a path which has already been normalized
+		[[nodiscard]] constexpr auto hash_normalized(std::string_view a_path) noexcept
+			-> hashing::hash
+		{
+			hashing::hash h;
+
+			const std::size_t midpoint = a_path.length() / 2u;
+			std::size_t i = 0;
+			for (; i < midpoint; ++i) {
+				// rotate between first 4 bytes
+				h.lo ^= std::uint32_t{ static_cast<unsigned char>(a_path[i]) }
+				        << ((i % 4u) * 8u);
+			}
+
+			for (std::uint32_t rot = 0; i < a_path.length(); ++i) {
+				// rotate between last 4 bytes
+				rot = std::uint32_t{ static_cast<unsigned char>(a_path[i]) }
+				      << (((i - midpoint) % 4u) * 8u);
+				h.hi = std::rotr(h.hi ^ rot, static_cast<int>(rot));
+			}
+
+			return h;
+		}
+	}
+#endif
+
+	namespace hashing
+	{
+		/// \brief	User-defined literals which produce hashes at compile time.
+		/// \details	Lookups using a precomputed hash skip normalizing and hashing the path at runtime,
+		///		i.e. `archive.find("meshes/clutter/bucket.nif"_file_hash)`.
+		namespace literals
+		{
+			/// \brief	Produces a hash for the given file path at compile time.
+			/// \remark	Equivalent to \ref bsa::tes3::hashing::hash_file.
+			[[nodiscard]] consteval hash operator""_file_hash(
+				const char* a_path,
+				std::size_t a_length) noexcept
+			{
+				std::array<char, detail::max_path> buffer{};
+				return detail::hash_normalized(
+					detail::normalize_path_constexpr({ a_path, a_length }, buffer));
+			}
+		}
 	}
 
 	/// \brief	Represents a file within the TES3 virtual filesystem.
@@ -99,7 +176,7 @@ namespace bsa::tes3
 		/// @{
 
 		/// \brief	The key used to indentify a file.
-		using key = components::key<hashing::hash, hashing::hash_file_in_place>;
+		using key = components::key<hashing::hash, hashing::hash_file_in_place, hashing::hash_file>;
 
 		/// @}
 
@@ -131,6 +208,10 @@ namespace bsa::tes3
 		/// \copydoc bsa::doxygen_detail::write
 		///
 		/// \param	a_sink	Where/how to write the given file.
+		///
+		/// \remark	When writing to a path, uncompressed data which was read from a file on
+		///		the native filesystem is copied by the kernel where the platform supports it,
+		///		without passing through the process.
 		void write(write_sink a_sink) const;
 
 		/// @}
@@ -138,21 +219,21 @@ namespace bsa::tes3
 
 	/// \brief	Represents the TES3 revision of the bsa format.
 	class archive final :
-		public components::hashmap<file>
+		public components::hashmap<file, false, detail::hashmap_storage>
 	{
 	private:
-		using super = components::hashmap<file>;
+		using super = components::hashmap<file, false, detail::hashmap_storage>;
 
 	public:
 		/// \name Modifiers
 		/// @{
 
-#ifdef DOXYGEN
 		/// \brief	Clears the contents of the archive.
-		void clear() noexcept;
-#else
-		using super::clear;
-#endif
+		void clear() noexcept
+		{
+			super::clear();
+			_file.reset();
+		}
 
 		/// @}
 
@@ -189,19 +270,33 @@ namespace bsa::tes3
 		/// @}
 
 	private:
+		struct layout_t;
 		struct offsets_t;
 
-		[[nodiscard]] auto make_header() const noexcept -> detail::header_t;
+		[[nodiscard]] auto make_layout() const -> layout_t;
 
-		void read_file(
+		[[nodiscard]] auto read_file(
 			detail::istream_t& a_in,
 			const offsets_t& a_offsets,
-			std::size_t a_idx);
-
-		void write_file_entries(detail::ostream_t& a_out) const noexcept;
-		void write_file_name_offsets(detail::ostream_t& a_out) const noexcept;
-		void write_file_names(detail::ostream_t& a_out) const noexcept;
-		void write_file_hashes(detail::ostream_t& a_out) const noexcept;
-		void write_file_data(detail::ostream_t& a_out) const noexcept;
+			std::size_t a_idx)
+			-> std::pair<key_type, mapped_type>;
+
+		void write_file_entries(
+			const layout_t& a_layout,
+			detail::ostream_t& a_out) const noexcept;
+		void write_file_name_offsets(
+			const layout_t& a_layout,
+			detail::ostream_t& a_out) const noexcept;
+		void write_file_names(
+			const layout_t& a_layout,
+			detail::ostream_t& a_out) const noexcept;
+		void write_file_hashes(
+			const layout_t& a_layout,
+			detail::ostream_t& a_out) const noexcept;
+		void write_file_data(
+			const layout_t& a_layout,
+			detail::ostream_t& a_out) const noexcept;
+
+		std::shared_ptr<detail::istream_t::file_type> _file;
 	};
 }
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <compare>
 #include <cstddef>
 #include <cstdint>
 #include <filesystem>
+#include <memory>
 #include <optional>
 #include <span>
 #include <string>
@@ -120,10 +123,32 @@ namespace bsa::tes4
 		sse = 105,
 	};
 
+	/// \brief	Controls how much of an archive is parsed up front.
+	enum class read_mode
+	{
+		/// \brief	Parses every file record while reading the archive.
+		eager,
+
+		/// \brief	Parses only the directory and file tables while reading the archive.
+		/// \details	The prefixes stored next to each file's data (its embedded name and
+		///		decompressed size) are not touched until the file is first accessed, which
+		///		avoids faulting in the data section of a mapped archive just to open it. As a
+		///		consequence, a malformed embedded name is only reported once its file is accessed.
+		/// \remark	Only applies to sources read with \ref copy_type::shallow. Deep copies
+		///		are always read eagerly.
+		lazy,
+	};
+
 #ifndef DOXYGEN
 	namespace detail
 	{
 		using namespace bsa::detail;
+
+#	ifdef BSA_TES4_FLAT_HASHMAP
+		using hashmap_storage = components::flat_storage;
+#	else
+		using hashmap_storage = components::tree_storage;
+#	endif
 	}
 #endif
 
@@ -152,7 +177,7 @@ namespace bsa::tes4
 
 			[[nodiscard]] friend bool operator==(const hash&, const hash&) noexcept = default;
 
-			[[nodiscard]] friend std::strong_ordering operator<=>(
+			[[nodiscard]] friend constexpr std::strong_ordering operator<=>(
 				const hash& a_lhs,
 				const hash& a_rhs) noexcept
 			{
@@ -165,7 +190,7 @@ namespace bsa::tes4
 			/// @{
 
 			/// \copybrief bsa::tes3::hashing::hash
-			[[nodiscard]] std::uint64_t numeric() const noexcept
+			[[nodiscard]] constexpr std::uint64_t numeric() const noexcept
 			{
 				return std::uint64_t{
 					std::uint64_t{ last } << 0u * 8u |
@@ -196,24 +221,188 @@ namespace bsa::tes4
 		/// \copydoc bsa::tes3::hashing::hash_file_in_place()
 		[[nodiscard]] hash hash_directory_in_place(std::string& a_path) noexcept;
 
+		/// \copydoc bsa::tes3::hashing::hash_file(std::string_view)
+		[[nodiscard]] hash hash_directory(std::string_view a_path) noexcept;
+
 		/// \copydoc bsa::tes3::hashing::hash_file()
 		template <concepts::stringable String>
-		[[nodiscard]] hash hash_directory(String&& a_path) noexcept
+		[[nodiscard]] hash hash_directory(String&& a_path) noexcept  //
+			requires(!std::convertible_to<String, std::string_view>)
 		{
 			std::string str(std::forward<String>(a_path));
 			return hash_directory_in_place(str);
 		}
 
+		/// \copydoc bsa::tes3::hashing::hash_files()
+		void hash_directories(
+			std::span<const std::string_view> a_paths,
+			std::span<hash> a_hashes,
+			const executor& a_executor = default_executor());
+
 		/// \copydoc bsa::tes3::hashing::hash_file_in_place()
 		[[nodiscard]] hash hash_file_in_place(std::string& a_path) noexcept;
 
+		/// \copydoc bsa::tes3::hashing::hash_file(std::string_view)
+		[[nodiscard]] hash hash_file(std::string_view a_path) noexcept;
+
 		/// \copydoc bsa::tes3::hashing::hash_file()
 		template <concepts::stringable String>
-		[[nodiscard]] hash hash_file(String&& a_path) noexcept
+		[[nodiscard]] hash hash_file(String&& a_path) noexcept  //
+			requires(!std::convertible_to<String, std::string_view>)
 		{
 			std::string str(std::forward<String>(a_path));
 			return hash_file_in_place(str);
 		}
+
+		/// \copydoc bsa::tes3::hashing::hash_files()
+		void hash_files(
+			std::span<const std::string_view> a_paths,
+			std::span<hash> a_hashes,
+			const executor& a_executor = default_executor());
+	}
+
+#ifndef DOXYGEN
+	namespace detail
+	{
+		[[nodiscard]] constexpr auto crc32(std::string_view a_bytes) noexcept
+			-> std::uint32_t
+		{
+			constexpr auto constant = std::uint32_t{ 0x1003Fu };
+
+			// the hash is a polynomial in the constant, so eight bytes at a time it expands to
+			// crc * k^8 + b0 * k^7 + ... + b7 * k^0, whose multiplies are independent of each other
+			constexpr auto k = []() noexcept {
+				std::array<std::uint32_t, 9> powers{};
+				powers[0] = 1;
+				for (std::size_t i = 1; i < powers.size(); ++i) {
+					powers[i] = powers[i - 1] * constant;
+				}
+				return powers;
+			}();
+
+			const auto b = [&](std::size_t a_idx) noexcept {
+				return std::uint32_t{ static_cast<unsigned char>(a_bytes[a_idx]) };
+			};
+
+			std::uint32_t crc = 0;
+			std::size_t i = 0;
+			for (; i + 8 <= a_bytes.size(); i += 8) {
+				crc = crc * k[8] +
+				      (b(i + 0) * k[7] + b(i + 1) * k[6]) +
+				      (b(i + 2) * k[5] + b(i + 3) * k[4]) +
+				      (b(i + 4) * k[3] + b(i + 5) * k[2]) +
+				      (b(i + 6) * k[1] + b(i + 7));
+			}
+
+			for (; i < a_bytes.size(); ++i) {
+				crc = b(i) + crc * constant;
+			}
+
+			return crc;
+		}
+
+		// hashes a directory path which has already been normalized
+		[[nodiscard]] constexpr auto hash_directory_normalized(std::string_view a_path) noexcept
+			-> hashing::hash
+		{
+			hashing::hash h;
+
+			switch (std::min<std::size_t>(a_path.size(), 3)) {
+			case 3:
+				h.last2 = static_cast<std::uint8_t>(*(a_path.end() - 2));
+				[[fallthrough]];
+			case 2:
+			case 1:
+				h.last = static_cast<std::uint8_t>(a_path.back());
+				h.first = static_cast<std::uint8_t>(a_path.front());
+				[[fallthrough]];
+			default:
+				break;
+			}
+
+			h.length = static_cast<std::uint8_t>(a_path.size());
+			if (h.length > 3) {
+				// skip first and last two chars -> already processed
+				h.crc = crc32(a_path.substr(1, a_path.size() - 3));
+			}
+
+			return h;
+		}
+
+		// hashes a file path which has already been normalized, using only the file name
+		[[nodiscard]] constexpr auto hash_file_normalized(std::string_view a_path) noexcept
+			-> hashing::hash
+		{
+			constexpr std::array lut{
+				make_four_cc(""sv),
+				make_four_cc(".nif"sv),
+				make_four_cc(".kf"sv),
+				make_four_cc(".dds"sv),
+				make_four_cc(".wav"sv),
+				make_four_cc(".adp"sv),
+			};
+
+			if (const auto pos = a_path.find_last_of('\\'); pos != std::string_view::npos) {
+				a_path = a_path.substr(pos + 1);
+			}
+
+			const auto split = a_path.find_last_of('.');
+			const auto stem = a_path.substr(0, split);
+			const auto extension = split != std::string_view::npos ? a_path.substr(split) : ""sv;
+
+			if (!stem.empty() &&
+				stem.length() < max_path &&
+				extension.length() < 16) {
+				// the stem is already normalized, and can not contain any separators
+				auto h = hash_directory_normalized(stem);
+				h.crc += crc32(extension);
+
+				const auto it = std::find(
+					lut.begin(),
+					lut.end(),
+					make_four_cc(extension));
+				if (it != lut.end()) {
+					const auto i = static_cast<std::uint8_t>(it - lut.begin());
+					h.first += 32u * (i & 0xFCu);
+					h.last += (i & 0xFEu) << 6u;
+					h.last2 += i << 7u;
+				}
+
+				return h;
+			} else {
+				return {};
+			}
+		}
+	}
+#endif
+
+	namespace hashing
+	{
+		/// \copydoc bsa::tes3::hashing::literals
+		namespace literals
+		{
+			/// \brief	Produces a hash for the given directory path at compile time.
+			/// \remark	Equivalent to \ref bsa::tes4::hashing::hash_directory.
+			[[nodiscard]] consteval hash operator""_directory_hash(
+				const char* a_path,
+				std::size_t a_length) noexcept
+			{
+				std::array<char, detail::max_path> buffer{};
+				return detail::hash_directory_normalized(
+					detail::normalize_path_constexpr({ a_path, a_length }, buffer));
+			}
+
+			/// \brief	Produces a hash for the given file path at compile time.
+			/// \remark	Equivalent to \ref bsa::tes4::hashing::hash_file.
+			[[nodiscard]] consteval hash operator""_file_hash(
+				const char* a_path,
+				std::size_t a_length) noexcept
+			{
+				std::array<char, detail::max_path> buffer{};
+				return detail::hash_file_normalized(
+					detail::normalize_path_constexpr({ a_path, a_length }, buffer));
+			}
+		}
 	}
 
 	/// \brief	Represents a file within the TES4 virtual filesystem.
@@ -248,6 +437,12 @@ namespace bsa::tes4
 		/// bsa::tes4::file::compression_params{
 		///		.version_ = bsa::tes4::version::sse,
 		/// };
+		///
+		/// // Configure for SSE, favouring size over speed
+		/// bsa::tes4::file::compression_params{
+		///		.version_ = bsa::tes4::version::sse,
+		///		.compression_preset_ = bsa::compression_preset::max,
+		/// };
 		/// \endcode
 		struct compression_params final
 		{
@@ -257,6 +452,10 @@ namespace bsa::tes4
 
 			/// \brief	The codec to use.
 			compression_codec compression_codec_{ compression_codec::normal };
+
+			/// \brief	The speed/ratio trade-off to compress with.
+			/// \remark	Has no effect on decompression, or on the xmem codec.
+			compression_preset compression_preset_{ compression_preset::normal };
 		};
 
 		/// \brief	Common parameters to configure how files are read.
@@ -296,6 +495,10 @@ namespace bsa::tes4
 			/// \brief	The codec to use.
 			compression_codec compression_codec_{ compression_codec::normal };
 
+			/// \brief	The speed/ratio trade-off to compress with.
+			/// \remark	Has no effect on the xmem codec.
+			compression_preset compression_preset_{ compression_preset::normal };
+
 			/// \brief	The resulting compression of the file read.
 			compression_type compression_type_{ compression_type::decompressed };
 		};
@@ -338,7 +541,7 @@ namespace bsa::tes4
 		/// @{
 
 		/// \brief	The key used to indentify a file.
-		using key = components::key<hashing::hash, hashing::hash_file_in_place>;
+		using key = components::key<hashing::hash, hashing::hash_file_in_place, hashing::hash_file>;
 
 		/// @}
 
@@ -428,9 +631,15 @@ namespace bsa::tes4
 
 		[[nodiscard]] auto compress_bound_xmem() const -> std::size_t;
 
-		[[nodiscard]] auto compress_into_lz4(std::span<std::byte> a_out) const -> std::size_t;
+		[[nodiscard]] auto compress_into_lz4(
+			std::span<std::byte> a_out,
+			compression_preset a_preset) const
+			-> std::size_t;
 		[[nodiscard]] auto compress_into_xmem(std::span<std::byte> a_out) const -> std::size_t;
-		[[nodiscard]] auto compress_into_zlib(std::span<std::byte> a_out) const -> std::size_t;
+		[[nodiscard]] auto compress_into_zlib(
+			std::span<std::byte> a_out,
+			compression_preset a_preset) const
+			-> std::size_t;
 
 		void decompress_into_lz4(std::span<std::byte> a_out) const;
 		void decompress_into_xmem(std::span<std::byte> a_out) const;
@@ -439,18 +648,18 @@ namespace bsa::tes4
 
 	/// \brief	Represents a directory within the TES4 virtual filesystem.
 	class directory final :
-		public components::hashmap<file>
+		public components::hashmap<file, false, detail::hashmap_storage>
 	{
 	private:
 		friend archive;
-		using super = components::hashmap<file>;
+		using super = components::hashmap<file, false, detail::hashmap_storage>;
 
 	public:
 		/// \name Member types
 		/// @{
 
 		/// \brief	The key used to indentify a directory.
-		using key = components::key<hashing::hash, hashing::hash_directory_in_place>;
+		using key = components::key<hashing::hash, hashing::hash_directory_in_place, hashing::hash_directory>;
 
 		/// @}
 
@@ -469,10 +678,10 @@ namespace bsa::tes4
 
 	/// \brief	Represents the TES4 revision of the bsa format.
 	class archive final :
-		public components::hashmap<directory, true>
+		public components::hashmap<directory, true, detail::hashmap_storage>
 	{
 	private:
-		using super = components::hashmap<directory, true>;
+		using super = components::hashmap<directory, true, detail::hashmap_storage>;
 
 	public:
 		/// \name Archive flags
@@ -544,17 +753,76 @@ namespace bsa::tes4
 			super::clear();
 			_flags = archive_flag::none;
 			_types = archive_type::none;
+			_file.reset();
 		}
 
 		/// @}
 
+		/// \name Compression
+		/// @{
+
+		/// \brief	Compresses every uncompressed file in the archive.
+		/// \details	Files are independent of each other, so they are compressed concurrently
+		///		using the given executor. Files which are already compressed are left untouched.
+		///		The result is identical to compressing each file one at a time.
+		///
+		/// \param	a_params	Extra configuration options.
+		/// \param	a_executor	The executor to run compression tasks on.
+		///
+		/// \exception	bsa::compression_error	Rethrown from the first file which failed to
+		///		compress, after every other file has finished.
+		void compress_all(
+			const file::compression_params& a_params,
+			const executor& a_executor = default_executor());
+
+		/// \brief	Compresses the given files.
+		/// \copydetails	archive::compress_all
+		///
+		/// \param	a_files	The files to compress. Each file *must* appear at most once.
+		static void compress(
+			std::span<file* const> a_files,
+			const file::compression_params& a_params,
+			const executor& a_executor = default_executor());
+
+		/// @}
+
+		/// \name Decompression
+		/// @{
+
+		/// \brief	Decompresses every compressed file in the archive.
+		/// \details	Files are independent of each other, so they are decompressed concurrently
+		///		using the given executor. Files which are not compressed are left untouched.
+		///
+		/// \param	a_params	Extra configuration options.
+		/// \param	a_executor	The executor to run decompression tasks on.
+		///
+		/// \exception	bsa::compression_error	Rethrown from the first file which failed to
+		///		decompress, after every other file has finished.
+		void decompress_all(
+			const file::compression_params& a_params,
+			const executor& a_executor = default_executor());
+
+		/// \brief	Decompresses the given files.
+		/// \copydetails	archive::decompress_all
+		///
+		/// \param	a_files	The files to decompress. Each file *must* appear at most once.
+		static void decompress(
+			std::span<file* const> a_files,
+			const file::compression_params& a_params,
+			const executor& a_executor = default_executor());
+
+		/// @}
+
 		/// \name Reading
 		/// @{
 
 		/// \copydoc bsa::tes3::archive::read
 		///
+		/// \param	a_mode	Controls how much of the archive is parsed up front.
 		/// \return	The version of the archive that was read.
-		version read(read_source a_source);
+		version read(
+			read_source a_source,
+			read_mode a_mode = read_mode::eager);
 
 		/// @}
 
@@ -564,7 +832,9 @@ namespace bsa::tes4
 		/// \copydoc bsa::tes3::archive::verify_offsets
 		///
 		/// \param	a_version	The version format to check for.
-		[[nodiscard]] bool verify_offsets(version a_version) const noexcept;
+		///
+		/// \exception	binary_io::buffer_exhausted	Thrown when a file read lazily is malformed.
+		[[nodiscard]] bool verify_offsets(version a_version) const;
 
 		/// @}
 
@@ -578,25 +848,61 @@ namespace bsa::tes4
 			write_sink a_sink,
 			version a_version) const;
 
+		/// \brief	Writes the archive, compressing files as they are written.
+		/// \details	The result is identical to calling \ref compress_all and then \ref write,
+		///		except that the archive itself is left untouched, and only a bounded window of
+		///		compressed files is ever held in memory. Files which are already compressed are
+		///		written as they are. Files are compressed using the given executor, while the
+		///		previous window of files is written out.
+		///
+		/// \remark	Space for the record tables is reserved up front, and they are filled in once
+		///		every file has been written, so the sink must support seeking.
+		///
+		/// \param	a_sink	Where/how to write the given archive.
+		/// \param	a_version	The version format to write the archive in.
+		/// \param	a_params	Extra configuration options for compression. Its
+		///		\ref file::compression_params::version_ "version" is ignored, and files are
+		///		compressed for `a_version` instead.
+		/// \param	a_executor	The executor to run compression tasks on.
+		///
+		/// \exception	bsa::compression_error	Rethrown from the first file which failed to
+		///		compress.
+		/// \exception	bsa::exception	Thrown when the offset or size of a compressed file can't
+		///		be represented within the archive. The record tables are left unwritten.
+		void write(
+			write_sink a_sink,
+			version a_version,
+			const file::compression_params& a_params,
+			const executor& a_executor = default_executor()) const;
+
+		/// \brief	Writes the archive to the native filesystem, writing file data concurrently.
+		/// \details	Every offset within the archive is known before anything is written, so the
+		///		output is preallocated, and the data of each file is written to its own region of
+		///		it using the given executor. The header and tables are written last. The result is
+		///		identical to \ref write.
+		///
+		/// \param	a_path	The path to write to on the native filesystem.
+		/// \param	a_version	The version format to write the archive in.
+		/// \param	a_executor	The executor to run write tasks on.
+		///
+		/// \exception	std::system_error	Thrown when filesystem errors are encountered.
+		void write(
+			const std::filesystem::path& a_path,
+			version a_version,
+			const executor& a_executor) const;
+
 		/// @}
 
 	private:
-		using intermediate_t =
-			std::vector<
-				std::pair<
-					const value_type*,
-					std::vector<const mapped_type::value_type*>>>;
-
-		struct xbox_sort_t;
-
-		[[nodiscard]] auto make_header(version a_version) const noexcept -> detail::header_t;
+		struct layout_t;
 
 		[[nodiscard]] auto read_file_entries(
 			directory& a_dir,
 			detail::istream_t& a_in,
 			const detail::header_t& a_header,
 			std::size_t a_count,
-			std::size_t& a_namesOffset) -> std::optional<std::string_view>;
+			std::span<const std::string_view>& a_names,
+			bool a_lazy) -> std::optional<std::string_view>;
 
 		void read_file_data(
 			file& a_file,
@@ -604,13 +910,22 @@ namespace bsa::tes4
 			const detail::header_t& a_header,
 			std::size_t a_size);
 
-		void read_directory(
+		void read_file_record(
+			file& a_file,
+			detail::istream_t& a_in,
+			const detail::header_t& a_header,
+			std::size_t a_size,
+			std::size_t a_record);
+
+		[[nodiscard]] auto read_directory(
 			detail::istream_t& a_in,
 			const detail::header_t& a_header,
 			std::size_t& a_filesOffset,
-			std::size_t& a_namesOffset);
+			std::span<const std::string_view>& a_names,
+			bool a_lazy)
+			-> std::pair<key_type, mapped_type>;
 
-		[[nodiscard]] auto sort_for_write(bool a_xbox) const noexcept -> intermediate_t;
+		[[nodiscard]] auto make_layout(version a_version) const -> layout_t;
 
 		[[nodiscard]] auto test_flag(archive_flag a_flag) const noexcept
 			-> bool { return (_flags & a_flag) != archive_flag::none; }
@@ -619,25 +934,27 @@ namespace bsa::tes4
 			-> bool { return (_types & a_type) != archive_type::none; }
 
 		void write_directory_entries(
-			const intermediate_t& a_intermediate,
-			detail::ostream_t& a_out,
-			const detail::header_t& a_header) const noexcept;
+			const layout_t& a_layout,
+			detail::ostream_t& a_out) const noexcept;
 
 		void write_file_data(
-			const intermediate_t& a_intermediate,
-			detail::ostream_t& a_out,
-			const detail::header_t& a_header) const noexcept;
+			const layout_t& a_layout,
+			detail::ostream_t& a_out) const;
 
 		void write_file_entries(
-			const intermediate_t& a_intermediate,
-			detail::ostream_t& a_out,
-			const detail::header_t& a_header) const noexcept;
+			const layout_t& a_layout,
+			detail::ostream_t& a_out) const noexcept;
 
 		void write_file_names(
-			const intermediate_t& a_intermediate,
+			const layout_t& a_layout,
+			detail::ostream_t& a_out) const noexcept;
+
+		void write_tables(
+			const layout_t& a_layout,
 			detail::ostream_t& a_out) const noexcept;
 
 		archive_flag _flags{ archive_flag::none };
 		archive_type _types{ archive_type::none };
+		std::shared_ptr<detail::istream_t::file_type> _file;
 	};
 }
@@ -1,14 +1,26 @@
 #include "bsa/detail/common.hpp"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <filesystem>
+#include <functional>
 #include <limits>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <span>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <thread>
 #include <tuple>
 #include <utility>
 #include <variant>
@@ -16,6 +28,27 @@
 #include <lz4frame.h>
 #include <zlib.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define BSA_HAS_SSE2 true
+#	include <emmintrin.h>
+#else
+#	define BSA_HAS_SSE2 false
+#endif
+
+#if BSA_OS_WINDOWS
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <Windows.h>
+#else
+#	include <cerrno>
+#	include <fcntl.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#	ifdef __linux__
+#		include <sys/sendfile.h>
+#	endif
+#endif
+
 #ifdef BSA_SUPPORT_XMEM
 #	include "bsa/xmem/xmem.hpp"
 #endif
@@ -24,6 +57,141 @@ namespace bsa
 {
 	namespace
 	{
+		// a fixed set of workers, which help the calling thread through each batch it runs
+		class thread_pool final
+		{
+		public:
+			explicit thread_pool(std::size_t a_workers)
+			{
+				_workers.reserve(a_workers);
+				for (std::size_t i = 0; i < a_workers; ++i) {
+					_workers.emplace_back([this]() { this->work(); });
+				}
+			}
+
+			thread_pool(const thread_pool&) = delete;
+			thread_pool(thread_pool&&) = delete;
+
+			~thread_pool() noexcept
+			{
+				{
+					const std::lock_guard l{ _lock };
+					_stop = true;
+				}
+				_wake.notify_all();
+			}
+
+			thread_pool& operator=(const thread_pool&) = delete;
+			thread_pool& operator=(thread_pool&&) = delete;
+
+			// safe to call concurrently, and from within a task
+			void run(
+				std::size_t a_count,
+				const std::function<void(std::size_t)>& a_task)
+			{
+				const auto batch = std::make_shared<batch_t>(a_count, a_task);
+				const auto helpers = a_count > 1 ? (std::min)(_workers.size(), a_count - 1) : 0;
+				if (helpers > 0) {
+					{
+						const std::lock_guard l{ _lock };
+						_batches.push_back(batch);
+					}
+					for (std::size_t i = 0; i < helpers; ++i) {
+						_wake.notify_one();
+					}
+				}
+
+				batch->work();
+				if (helpers > 0) {
+					this->retire(batch);
+					std::unique_lock l{ batch->lock };
+					batch->done.wait(l, [&]() noexcept { return batch->finished == a_count; });
+				}
+
+				if (batch->error) {
+					std::rethrow_exception(batch->error);
+				}
+			}
+
+		private:
+			struct batch_t final
+			{
+				batch_t(
+					std::size_t a_count,
+					const std::function<void(std::size_t)>& a_task) noexcept :
+					count(a_count),
+					task(a_task)
+				{}
+
+				[[nodiscard]] bool exhausted() const noexcept { return next >= count; }
+
+				void work() noexcept
+				{
+					for (auto i = next++; i < count; i = next++) {
+						try {
+							task(i);
+						} catch (...) {
+							const std::lock_guard l{ lock };
+							if (!error) {
+								error = std::current_exception();
+							}
+						}
+
+						if (++finished == count) {
+							const std::lock_guard l{ lock };
+							done.notify_all();
+						}
+					}
+				}
+
+				const std::size_t count;
+				const std::function<void(std::size_t)>& task;
+				std::atomic_size_t next{ 0 };
+				std::atomic_size_t finished{ 0 };
+				std::mutex lock;
+				std::condition_variable done;
+				std::exception_ptr error;
+			};
+
+			// removes a batch from the queue, once every task in it has been handed out
+			void retire(const std::shared_ptr<batch_t>& a_batch)
+			{
+				const std::lock_guard l{ _lock };
+				const auto it = std::find(_batches.begin(), _batches.end(), a_batch);
+				if (it != _batches.end()) {
+					_batches.erase(it);
+				}
+			}
+
+			void work()
+			{
+				while (true) {
+					std::shared_ptr<batch_t> batch;
+					{
+						std::unique_lock l{ _lock };
+						_wake.wait(l, [&]() noexcept { return _stop || !_batches.empty(); });
+						if (_stop) {
+							return;
+						}
+						batch = _batches.front();
+						if (batch->exhausted()) {
+							_batches.pop_front();
+							continue;
+						}
+					}
+
+					batch->work();
+					this->retire(batch);
+				}
+			}
+
+			std::mutex _lock;
+			std::condition_variable _wake;
+			std::deque<std::shared_ptr<batch_t>> _batches;
+			bool _stop{ false };
+			std::vector<std::jthread> _workers;  // last, so they're joined before anything else is destroyed
+		};
+
 		[[nodiscard]] auto guess_file_format(detail::istream_t& a_in)
 			-> std::optional<file_format>
 		{
@@ -53,6 +221,27 @@ namespace bsa
 		detail::istream_t in{ a_src, copy_type::shallow };
 		return guess_file_format(in);
 	}
+
+	auto make_thread_executor(std::size_t a_threads)
+		-> executor
+	{
+		if (a_threads == 0) {
+			a_threads = (std::max)(std::size_t{ std::thread::hardware_concurrency() }, std::size_t{ 1 });
+		}
+
+		auto pool = std::make_shared<thread_pool>(a_threads - 1);
+		return [pool = std::move(pool)](std::size_t a_count, const std::function<void(std::size_t)>& a_task) {
+			pool->run(a_count, a_task);
+		};
+	}
+
+	auto default_executor()
+		-> const executor&
+	{
+		// never destroyed, so that it can't be joined while static destructors still use it
+		static const auto* const result = new executor(make_thread_executor());
+		return *result;
+	}
 }
 
 namespace bsa::detail
@@ -61,7 +250,7 @@ namespace bsa::detail
 	{
 		[[nodiscard]] char mapchar(char a_ch) noexcept
 		{
-			constexpr auto lut = []() noexcept {
+			static constexpr auto lut = []() noexcept {
 				std::array<char, (std::numeric_limits<unsigned char>::max)() + 1> map{};
 				for (std::size_t i = 0; i < map.size(); ++i) {
 					map[i] = static_cast<char>(i);
@@ -79,24 +268,376 @@ namespace bsa::detail
 
 			return lut[static_cast<unsigned char>(a_ch)];
 		}
+
+		// lowercases ascii and converts '/' into '\\', in place
+		void map_chars(std::span<char> a_chars) noexcept
+		{
+			std::size_t i = 0;
+#if BSA_HAS_SSE2
+			const auto first = _mm_set1_epi8('A' - 1);
+			const auto last = _mm_set1_epi8('Z' + 1);
+			const auto offset = _mm_set1_epi8('a' - 'A');
+			const auto slash = _mm_set1_epi8('/');
+			const auto flip = _mm_set1_epi8('/' ^ '\\');
+			for (; i + 16 <= a_chars.size(); i += 16) {
+				const auto addr = reinterpret_cast<__m128i*>(a_chars.data() + i);
+				auto v = _mm_loadu_si128(addr);
+
+				// bytes >= 0x80 compare as negative, so they are never considered upper case
+				const auto upper = _mm_and_si128(_mm_cmpgt_epi8(v, first), _mm_cmplt_epi8(v, last));
+				v = _mm_add_epi8(v, _mm_and_si128(upper, offset));
+				v = _mm_xor_si128(v, _mm_and_si128(_mm_cmpeq_epi8(v, slash), flip));
+
+				_mm_storeu_si128(addr, v);
+			}
+#endif
+			for (; i < a_chars.size(); ++i) {
+				a_chars[i] = mapchar(a_chars[i]);
+			}
+		}
 	}
 
 	void normalize_path(std::string& a_path) noexcept
 	{
-		for (auto& c : a_path) {
-			c = mapchar(c);
+		map_chars(a_path);
+
+		const auto last = a_path.find_last_not_of('\\');
+		if (last == std::string::npos) {
+			a_path = '.';
+			return;
 		}
 
-		while (!a_path.empty() && a_path.back() == '\\') {
-			a_path.pop_back();
+		a_path.erase(last + 1);
+		a_path.erase(0, a_path.find_first_not_of('\\'));
+
+		if (a_path.size() >= max_path) {
+			a_path = '.';
 		}
+	}
 
-		while (!a_path.empty() && a_path.front() == '\\') {
-			a_path.erase(a_path.begin());
+	auto normalize_path(
+		std::string_view a_path,
+		std::span<char, max_path> a_buffer) noexcept
+		-> std::string_view
+	{
+		// only separators map to '\\', so we can trim before mapping
+		const auto first = a_path.find_first_not_of("/\\"sv);
+		if (first == std::string_view::npos) {
+			return "."sv;
 		}
 
-		if (a_path.empty() || a_path.size() >= 260) {
-			a_path = '.';
+		const auto last = a_path.find_last_not_of("/\\"sv);
+		const auto len = last - first + 1;
+		if (len >= max_path) {
+			return "."sv;
+		}
+
+		const auto result = a_buffer.first(len);
+		std::copy_n(a_path.data() + first, len, result.data());
+		map_chars(result);
+		return { result.data(), result.size() };
+	}
+
+	void parallel_for(
+		const executor& a_executor,
+		std::size_t a_count,
+		const std::function<void(std::size_t)>& a_func)
+	{
+		if (a_count == 0) {
+			return;
+		}
+
+		std::mutex lock;
+		std::exception_ptr error;
+		const auto task = [&](std::size_t a_idx) {
+			try {
+				a_func(a_idx);
+			} catch (...) {
+				const std::lock_guard _{ lock };
+				if (!error) {
+					error = std::current_exception();
+				}
+			}
+		};
+
+		if (a_executor) {
+			a_executor(a_count, task);
+		} else {
+			for (std::size_t i = 0; i < a_count; ++i) {
+				task(i);
+			}
+		}
+
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+
+#if BSA_OS_WINDOWS
+	mapped_file::mapped_file(const std::filesystem::path& a_path) :
+		_map(a_path)
+	{}
+
+	auto mapped_file::open_handle() const noexcept
+		-> std::intptr_t
+	{
+		return -1;
+	}
+
+	void mapped_file::close_handle(std::intptr_t) noexcept {}
+
+	positional_ostream::positional_ostream(
+		const std::filesystem::path& a_path,
+		std::size_t a_size)
+	{
+		const auto handle = ::CreateFileW(
+			a_path.c_str(),
+			GENERIC_WRITE,
+			0,
+			nullptr,
+			CREATE_ALWAYS,
+			FILE_ATTRIBUTE_NORMAL,
+			nullptr);
+		if (handle == INVALID_HANDLE_VALUE) {
+			throw std::system_error(
+				static_cast<int>(::GetLastError()),
+				std::system_category(),
+				"failed to open file");
+		}
+		_handle = reinterpret_cast<std::intptr_t>(handle);
+
+		LARGE_INTEGER size;
+		size.QuadPart = static_cast<LONGLONG>(a_size);
+		if (!::SetFilePointerEx(handle, size, nullptr, FILE_BEGIN) ||
+			!::SetEndOfFile(handle)) {
+			const auto error = ::GetLastError();
+			::CloseHandle(handle);
+			throw std::system_error(
+				static_cast<int>(error),
+				std::system_category(),
+				"failed to preallocate file");
+		}
+	}
+
+	positional_ostream::~positional_ostream() noexcept
+	{
+		::CloseHandle(reinterpret_cast<HANDLE>(_handle));
+	}
+
+	void positional_ostream::write_bytes(
+		std::size_t a_offset,
+		std::span<const std::byte> a_bytes) const
+	{
+		while (!a_bytes.empty()) {
+			OVERLAPPED overlapped{};
+			overlapped.Offset = static_cast<DWORD>(a_offset);
+			overlapped.OffsetHigh = static_cast<DWORD>(static_cast<std::uint64_t>(a_offset) >> 32u);
+
+			const auto count = static_cast<DWORD>((std::min)(
+				a_bytes.size(),
+				std::size_t{ (std::numeric_limits<std::int32_t>::max)() }));
+			DWORD written = 0;
+			if (!::WriteFile(
+					reinterpret_cast<HANDLE>(_handle),
+					a_bytes.data(),
+					count,
+					&written,
+					&overlapped)) {
+				throw std::system_error(
+					static_cast<int>(::GetLastError()),
+					std::system_category(),
+					"failed to write file");
+			}
+
+			a_offset += written;
+			a_bytes = a_bytes.subspan(written);
+		}
+	}
+
+	void positional_ostream::copy_bytes(
+		std::size_t a_offset,
+		const mapped_range& a_range,
+		std::intptr_t) const
+	{
+		this->write_bytes(a_offset, a_range.bytes);
+	}
+#else
+	mapped_file::mapped_file(const std::filesystem::path& a_path) :
+		_map(a_path)
+	{
+#	ifdef __linux__
+		// reads only ever need the mapping, so failing to identify the file just means the kernel
+		// won't be asked to copy anything
+		struct ::stat st = {};
+		if (::stat(a_path.c_str(), &st) == 0) {
+			_path = a_path;
+			_identity.emplace(st.st_dev, st.st_ino);
+		}
+#	endif
+	}
+
+	auto mapped_file::open_handle() const noexcept
+		-> std::intptr_t
+	{
+		if (!_identity) {
+			return -1;
+		}
+
+		// the path may have been replaced since it was mapped, in which case copying from it would
+		// copy the wrong bytes
+		const auto fd = ::open(_path.c_str(), O_RDONLY | O_CLOEXEC);
+		struct ::stat st = {};
+		if (fd != -1 &&
+			(::fstat(fd, &st) != 0 ||
+				std::pair<std::uint64_t, std::uint64_t>{ st.st_dev, st.st_ino } != *_identity)) {
+			::close(fd);
+			return -1;
+		}
+
+		return fd;
+	}
+
+	void mapped_file::close_handle(std::intptr_t a_handle) noexcept
+	{
+		if (a_handle != -1) {
+			::close(static_cast<int>(a_handle));
+		}
+	}
+
+	positional_ostream::positional_ostream(
+		const std::filesystem::path& a_path,
+		std::size_t a_size)
+	{
+		const auto fd = ::open(a_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+		if (fd == -1) {
+			throw std::system_error(errno, std::generic_category(), "failed to open file");
+		}
+		_handle = fd;
+
+		if (::ftruncate(fd, static_cast<::off_t>(a_size)) != 0) {
+			const auto error = errno;
+			::close(fd);
+			throw std::system_error(error, std::generic_category(), "failed to preallocate file");
+		}
+	}
+
+	positional_ostream::~positional_ostream() noexcept
+	{
+		::close(static_cast<int>(_handle));
+	}
+
+	void positional_ostream::write_bytes(
+		std::size_t a_offset,
+		std::span<const std::byte> a_bytes) const
+	{
+		while (!a_bytes.empty()) {
+			const auto written = ::pwrite(
+				static_cast<int>(_handle),
+				a_bytes.data(),
+				a_bytes.size(),
+				static_cast<::off_t>(a_offset));
+			if (written < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				throw std::system_error(errno, std::generic_category(), "failed to write file");
+			}
+
+			a_offset += static_cast<std::size_t>(written);
+			a_bytes = a_bytes.subspan(static_cast<std::size_t>(written));
+		}
+	}
+
+	void positional_ostream::copy_bytes(
+		std::size_t a_offset,
+		const mapped_range& a_range,
+		[[maybe_unused]] std::intptr_t a_source) const
+	{
+		auto bytes = a_range.bytes;
+#	ifdef __linux__
+		// any failure just hands the rest of the range to write_bytes, which reports the errors
+		// that aren't the kernel declining to copy
+		const auto in = static_cast<int>(a_source);
+		const auto out = static_cast<int>(_handle);
+		auto src = static_cast<::off_t>(bytes.data() - a_range.file->data());
+		auto dst = static_cast<::off_t>(a_offset);
+		while (in != -1 && !bytes.empty()) {
+			const auto copied = ::copy_file_range(in, &src, out, &dst, bytes.size(), 0);
+			if (copied > 0) {
+				bytes = bytes.subspan(static_cast<std::size_t>(copied));
+			} else if (copied == 0 || errno != EINTR) {
+				break;
+			}
+		}
+
+		// older kernels won't copy across filesystems, but sendfile will (at the file offset)
+		if (in != -1 && !bytes.empty() && ::lseek(out, dst, SEEK_SET) == dst) {
+			while (!bytes.empty()) {
+				const auto copied = ::sendfile(out, in, &src, bytes.size());
+				if (copied > 0) {
+					bytes = bytes.subspan(static_cast<std::size_t>(copied));
+				} else if (copied == 0 || errno != EINTR) {
+					break;
+				}
+			}
+		}
+#	endif
+
+		this->write_bytes(a_offset + (a_range.bytes.size() - bytes.size()), bytes);
+	}
+#endif
+
+	namespace
+	{
+		// the handle to whichever mapped file is currently being copied from
+		class source_handle final
+		{
+		public:
+			source_handle() noexcept = default;
+			source_handle(const source_handle&) = delete;
+			source_handle(source_handle&&) = delete;
+
+			~source_handle() noexcept { mapped_file::close_handle(_handle); }
+
+			source_handle& operator=(const source_handle&) = delete;
+			source_handle& operator=(source_handle&&) = delete;
+
+			[[nodiscard]] auto file() const noexcept -> const mapped_file* { return _file; }
+			[[nodiscard]] auto get() const noexcept -> std::intptr_t { return _handle; }
+
+			void reset(const mapped_file* a_file) noexcept
+			{
+				mapped_file::close_handle(_handle);
+				_file = a_file;
+				_handle = a_file ? a_file->open_handle() : -1;
+			}
+
+		private:
+			const mapped_file* _file{ nullptr };
+			std::intptr_t _handle{ -1 };
+		};
+	}
+
+	void write_mapped(
+		const std::filesystem::path& a_path,
+		std::span<const mapped_range> a_ranges)
+	{
+		std::size_t size = 0;
+		for (const auto& range : a_ranges) {
+			size += range.bytes.size();
+		}
+
+		// sources are only held open while they're being copied from, since every open mapping
+		// would otherwise cost a second descriptor
+		const positional_ostream out{ a_path, size };
+		source_handle source;
+		std::size_t offset = 0;
+		for (const auto& range : a_ranges) {
+			if (source.file() != range.file) {
+				source.reset(range.file);
+			}
+			out.copy_bytes(offset, range, source.get());
+			offset += range.bytes.size();
 		}
 	}
 
@@ -133,13 +674,48 @@ namespace bsa::detail
 	auto read_zstring(detail::istream_t& a_in)
 		-> std::string_view
 	{
-		const auto first = reinterpret_cast<const char*>(a_in->read_bytes(1u).data());
-		auto last = first;
-		do {
-			++last;
-		} while (std::get<0>(a_in->read<char>()) != '\0');
+		const auto buf = a_in->rdbuf();
+		const auto pos = static_cast<std::size_t>(a_in->tell());
+		if (pos >= buf.size()) {
+			throw binary_io::buffer_exhausted();
+		}
+
+		const auto first = reinterpret_cast<const char*>(buf.data()) + pos;
+		const auto last = static_cast<const char*>(std::memchr(first, '\0', buf.size() - pos));
+		if (!last) {
+			throw binary_io::buffer_exhausted();
+		}
+
+		const auto len = static_cast<std::size_t>(last - first);
+		a_in->seek_relative(static_cast<binary_io::streamoff>(len + 1u));  // skip null terminator
+		return { first, len };
+	}
+
+	auto read_zstrings(
+		detail::istream_t& a_in,
+		std::size_t a_count)
+		-> std::vector<std::string_view>
+	{
+		const auto buf = a_in->rdbuf();
+		const auto base = reinterpret_cast<const char*>(buf.data());
+		auto pos = (std::min)(static_cast<std::size_t>(a_in->tell()), buf.size());
+
+		std::vector<std::string_view> result;
+		// every string occupies at least its terminator
+		result.reserve((std::min)(a_count, buf.size() - pos));
+		while (result.size() < a_count && pos < buf.size()) {
+			const auto first = base + pos;
+			const auto last = static_cast<const char*>(std::memchr(first, '\0', buf.size() - pos));
+			if (!last) {
+				break;
+			}
+
+			result.emplace_back(first, static_cast<std::size_t>(last - first));
+			pos = static_cast<std::size_t>(last - base) + 1u;  // skip null terminator
+		}
 
-		return { first, last };
+		a_in->seek_absolute(static_cast<binary_io::streamoff>(pos));
+		return result;
 	}
 
 	void write_bzstring(detail::ostream_t& a_out, std::string_view a_string) noexcept
@@ -156,6 +732,15 @@ namespace bsa::detail
 			a_string.length() });
 	}
 
+	void write_zeros(detail::ostream_t& a_out, std::size_t a_count) noexcept
+	{
+		static constexpr std::array<std::byte, 0x1000> zeros{};
+		for (; a_count > zeros.size(); a_count -= zeros.size()) {
+			a_out.write_bytes(zeros);
+		}
+		a_out.write_bytes({ zeros.data(), a_count });
+	}
+
 	void write_zstring(detail::ostream_t& a_out, std::string_view a_string) noexcept
 	{
 		a_out.write_bytes({ //
@@ -164,10 +749,34 @@ namespace bsa::detail
 		a_out.write(std::byte{ '\0' });
 	}
 
-	istream_t::istream_t(std::filesystem::path a_path) :
+	auto string_arena::push(std::string_view a_string)
+		-> std::string_view
+	{
+		if (a_string.empty()) {
+			return {};
+		}
+
+		if (_left < a_string.length()) {
+			const auto size = (std::max)(a_string.length(), _hint != 0 ? _hint : block_size);
+			_pos = _blocks.emplace_back(std::make_unique_for_overwrite<char[]>(size)).get();
+			_left = size;
+			_hint = 0;
+		}
+
+		const auto result = _pos;
+		std::copy(a_string.begin(), a_string.end(), result);
+		_pos += a_string.length();
+		_left -= a_string.length();
+		return { result, a_string.length() };
+	}
+
+	istream_t::istream_t(
+		std::filesystem::path a_path,
+		map_ownership a_ownership) :
 		_file(std::make_shared<file_type>(std::move(a_path))),
 		_stream({ _file->data(), _file->size() }),
-		_copy(copy_type::shallow)
+		_copy(copy_type::shallow),
+		_ownership(a_ownership)
 	{
 		_stream.endian(std::endian::little);
 	}
@@ -212,7 +821,31 @@ namespace bsa
 
 namespace bsa::components
 {
-	auto basic_byte_container::as_bytes() const noexcept
+	namespace
+	{
+		// an embedded name is only validated once its record is accessed, so that opening an
+		// archive doesn't have to touch the data of every file in it
+		[[nodiscard]] auto skip_name_prefix(
+			std::span<const std::byte> a_raw,
+			bool a_named,
+			bool a_sized)
+			-> std::span<const std::byte>
+		{
+			if (a_named) {
+				// records are checked to be long enough to hold the length of the name when read
+				assert(!a_raw.empty());
+				const auto len = std::size_t{ static_cast<std::uint8_t>(a_raw.front()) } + 1u;
+				if (len + (a_sized ? 4u : 0u) > a_raw.size()) {
+					throw binary_io::buffer_exhausted();
+				}
+				return a_raw.subspan(len);
+			} else {
+				return a_raw;
+			}
+		}
+	}
+
+	auto basic_byte_container::as_bytes() const
 		-> std::span<const std::byte>
 	{
 		switch (_data.index()) {
@@ -228,8 +861,52 @@ namespace bsa::components
 			}
 		case data_proxied:
 			return std::get_if<data_proxied>(&_data)->d;
+		case data_deferred:
+			{
+				const auto& deferred = *std::get_if<data_deferred>(&_data);
+				const auto bytes = skip_name_prefix(deferred.raw, deferred.name_prefix, deferred.size_prefix);
+				return deferred.size_prefix ? bytes.subspan(4) : bytes;
+			}
 		default:
 			detail::declare_unreachable();
 		}
 	}
+
+	auto basic_byte_container::mapped_range() const
+		-> std::optional<detail::mapped_range>
+	{
+		const detail::istream_t::file_type* file = nullptr;
+		switch (_data.index()) {
+		case data_proxied:
+			file = std::get_if<data_proxied>(&_data)->f.get();
+			break;
+		case data_deferred:
+			file = std::get_if<data_deferred>(&_data)->f.get();
+			break;
+		default:
+			break;
+		}
+
+		if (file) {
+			return detail::mapped_range{ file, this->as_bytes() };
+		} else {
+			return std::nullopt;
+		}
+	}
+
+	auto basic_byte_container::deferred_decompressed_size() const
+		-> std::optional<std::size_t>
+	{
+		const auto deferred = std::get_if<data_deferred>(&_data);
+		if (!deferred || !deferred->size_prefix) {
+			return std::nullopt;
+		}
+
+		const auto bytes = skip_name_prefix(deferred->raw, deferred->name_prefix, true);
+		std::size_t result = 0;
+		for (std::size_t i = 0; i < 4; ++i) {
+			result |= std::size_t{ static_cast<std::uint8_t>(bytes[i]) } << i * 8u;
+		}
+		return result;
+	}
 }
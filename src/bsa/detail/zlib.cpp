@@ -0,0 +1,308 @@
+#include "bsa/detail/zlib.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include <zlib.h>
+
+#ifdef BSA_USE_LIBDEFLATE
+#	include <array>
+
+#	include <libdeflate.h>
+#endif
+
+#include "bsa/detail/common.hpp"
+
+namespace bsa::detail
+{
+	namespace
+	{
+		// zlib keeps a pointer back to the stream in its state, so streams must never move
+		class deflate_stream final
+		{
+		public:
+			deflate_stream(
+				int a_level,
+				int a_windowBits,
+				int a_memLevel) :
+				_level(a_level),
+				_windowBits(a_windowBits),
+				_memLevel(a_memLevel)
+			{
+				if (const auto result = deflateInit2(
+						&_stream,
+						a_level,
+						Z_DEFLATED,
+						a_windowBits,
+						a_memLevel,
+						Z_DEFAULT_STRATEGY);
+					result != Z_OK) {
+					throw bsa::compression_error(bsa::compression_error::library::zlib, result);
+				}
+			}
+
+			deflate_stream(const deflate_stream&) = delete;
+			deflate_stream(deflate_stream&&) = delete;
+
+			~deflate_stream() noexcept { ::deflateEnd(&_stream); }
+
+			deflate_stream& operator=(const deflate_stream&) = delete;
+			deflate_stream& operator=(deflate_stream&&) = delete;
+
+			[[nodiscard]] auto get() noexcept -> ::z_stream& { return _stream; }
+
+			[[nodiscard]] bool matches(
+				int a_level,
+				int a_windowBits,
+				int a_memLevel) const noexcept
+			{
+				return _level == a_level &&
+				       _windowBits == a_windowBits &&
+				       _memLevel == a_memLevel;
+			}
+
+		private:
+			::z_stream _stream = {};
+			int _level;
+			int _windowBits;
+			int _memLevel;
+		};
+
+		// a deflate stream holds a couple hundred kilobytes of state, which is far more than most
+		// entries, so allocating it once per entry dominates compressing small entries
+		[[nodiscard]] auto get_deflate_stream(
+			int a_level,
+			int a_windowBits,
+			int a_memLevel)
+			-> ::z_stream&
+		{
+			// only a handful of parameter sets are ever used
+			thread_local std::vector<std::unique_ptr<deflate_stream>> streams;
+			const auto it = std::find_if(
+				streams.begin(),
+				streams.end(),
+				[&](const auto& a_stream) {
+					return a_stream->matches(a_level, a_windowBits, a_memLevel);
+				});
+			auto& stream = it != streams.end() ?
+			                   (*it)->get() :
+			                   streams.emplace_back(std::make_unique<deflate_stream>(a_level, a_windowBits, a_memLevel))->get();
+
+			// a previous entry may have failed partway through its stream
+			::deflateReset(&stream);
+			return stream;
+		}
+
+#ifdef BSA_USE_LIBDEFLATE
+		struct libdeflate_deleter final
+		{
+			void operator()(::libdeflate_compressor* a_compressor) const noexcept
+			{
+				::libdeflate_free_compressor(a_compressor);
+			}
+
+			void operator()(::libdeflate_decompressor* a_decompressor) const noexcept
+			{
+				::libdeflate_free_decompressor(a_decompressor);
+			}
+		};
+
+		// zlib's levels map onto the same range of libdeflate's levels
+		[[nodiscard]] auto get_libdeflate_compressor(int a_level)
+			-> ::libdeflate_compressor&
+		{
+			const auto level = a_level == Z_DEFAULT_COMPRESSION ? 6 : a_level;
+			thread_local std::array<std::unique_ptr<::libdeflate_compressor, libdeflate_deleter>, Z_BEST_COMPRESSION + 1> compressors;
+			auto& compressor = compressors.at(static_cast<std::size_t>(level));
+			if (!compressor) {
+				compressor.reset(::libdeflate_alloc_compressor(level));
+				if (!compressor) {
+					throw bsa::compression_error(bsa::compression_error::library::zlib, Z_MEM_ERROR);
+				}
+			}
+			return *compressor;
+		}
+
+		[[nodiscard]] auto get_libdeflate_decompressor()
+			-> ::libdeflate_decompressor&
+		{
+			thread_local const std::unique_ptr<::libdeflate_decompressor, libdeflate_deleter> decompressor{
+				::libdeflate_alloc_decompressor()
+			};
+			if (!decompressor) {
+				throw bsa::compression_error(bsa::compression_error::library::zlib, Z_MEM_ERROR);
+			}
+			return *decompressor;
+		}
+#else
+		class inflate_stream final
+		{
+		public:
+			inflate_stream()
+			{
+				// the largest window can decode streams written with any smaller window
+				if (const auto result = inflateInit2(&_stream, MAX_WBITS);
+					result != Z_OK) {
+					throw bsa::compression_error(bsa::compression_error::library::zlib, result);
+				}
+			}
+
+			inflate_stream(const inflate_stream&) = delete;
+			inflate_stream(inflate_stream&&) = delete;
+
+			~inflate_stream() noexcept { ::inflateEnd(&_stream); }
+
+			inflate_stream& operator=(const inflate_stream&) = delete;
+			inflate_stream& operator=(inflate_stream&&) = delete;
+
+			[[nodiscard]] auto get() noexcept -> ::z_stream& { return _stream; }
+
+		private:
+			::z_stream _stream = {};
+		};
+
+		[[nodiscard]] auto get_inflate_stream()
+			-> ::z_stream&
+		{
+			thread_local inflate_stream stream;
+			::inflateReset(&stream.get());
+			return stream.get();
+		}
+#endif
+	}
+
+	auto zlib_level(compression_preset a_preset, int a_normal) noexcept
+		-> int
+	{
+		switch (a_preset) {
+		case compression_preset::fast:
+			return Z_BEST_SPEED;
+		case compression_preset::normal:
+			return a_normal;
+		case compression_preset::max:
+			return Z_BEST_COMPRESSION;
+		default:
+			declare_unreachable();
+		}
+	}
+
+	auto zlib_compress(
+		std::span<const std::byte> a_in,
+		std::span<std::byte> a_out,
+		int a_level,
+		int a_windowBits,
+		int a_memLevel)
+		-> std::size_t
+	{
+#ifdef BSA_USE_LIBDEFLATE
+		// libdeflate always declares the largest window, so smaller windows are left to zlib, as
+		// is anything libdeflate can't fit into the output
+		if (a_windowBits == MAX_WBITS) {
+			const auto result = ::libdeflate_zlib_compress(
+				&get_libdeflate_compressor(a_level),
+				a_in.data(),
+				a_in.size_bytes(),
+				a_out.data(),
+				a_out.size_bytes());
+			if (result != 0) {
+				return result;
+			}
+		}
+#endif
+
+		auto& stream = get_deflate_stream(a_level, a_windowBits, a_memLevel);
+		stream.next_out = reinterpret_cast<::Bytef*>(a_out.data());
+		stream.avail_out = 0;
+		stream.next_in = (z_const ::Bytef*)a_in.data();
+		stream.avail_in = 0;
+
+		auto insz = a_in.size_bytes();
+		auto outsz = a_out.size_bytes();
+		int error = Z_OK;
+		do {
+			if (stream.avail_out == 0) {
+				stream.avail_out = static_cast<::uInt>(
+					std::min<std::size_t>((std::numeric_limits<::uInt>::max)(), outsz));
+				outsz -= stream.avail_out;
+			}
+
+			if (stream.avail_in == 0) {
+				stream.avail_in = static_cast<::uInt>(
+					std::min<std::size_t>((std::numeric_limits<::uInt>::max)(), insz));
+				insz -= stream.avail_in;
+			}
+
+			error = ::deflate(&stream, insz > 0 ? Z_NO_FLUSH : Z_FINISH);
+		} while (error == Z_OK);
+
+		if (error != Z_STREAM_END) {
+			throw bsa::compression_error(bsa::compression_error::library::zlib, error);
+		}
+
+		return a_out.size_bytes() - outsz - stream.avail_out;
+	}
+
+	auto zlib_decompress(
+		std::span<const std::byte> a_in,
+		std::span<std::byte> a_out)
+		-> std::size_t
+	{
+#ifdef BSA_USE_LIBDEFLATE
+		std::size_t outsz = 0;
+		switch (::libdeflate_zlib_decompress(
+			&get_libdeflate_decompressor(),
+			a_in.data(),
+			a_in.size_bytes(),
+			a_out.data(),
+			a_out.size_bytes(),
+			&outsz)) {
+		case LIBDEFLATE_SUCCESS:
+			return outsz;
+		case LIBDEFLATE_INSUFFICIENT_SPACE:
+			throw bsa::compression_error(bsa::compression_error::library::zlib, Z_BUF_ERROR);
+		default:
+			throw bsa::compression_error(bsa::compression_error::library::zlib, Z_DATA_ERROR);
+		}
+#else
+		auto& stream = get_inflate_stream();
+		stream.next_out = reinterpret_cast<::Bytef*>(a_out.data());
+		stream.avail_out = 0;
+		stream.next_in = (z_const ::Bytef*)a_in.data();
+		stream.avail_in = 0;
+
+		auto insz = a_in.size_bytes();
+		auto outsz = a_out.size_bytes();
+		int error = Z_OK;
+		do {
+			if (stream.avail_out == 0) {
+				stream.avail_out = static_cast<::uInt>(
+					std::min<std::size_t>((std::numeric_limits<::uInt>::max)(), outsz));
+				outsz -= stream.avail_out;
+			}
+
+			if (stream.avail_in == 0) {
+				stream.avail_in = static_cast<::uInt>(
+					std::min<std::size_t>((std::numeric_limits<::uInt>::max)(), insz));
+				insz -= stream.avail_in;
+			}
+
+			error = ::inflate(&stream, Z_NO_FLUSH);
+		} while (error == Z_OK);
+
+		// report the same errors as uncompress
+		if (error == Z_NEED_DICT ||
+			(error == Z_BUF_ERROR && outsz + stream.avail_out > 0)) {
+			error = Z_DATA_ERROR;
+		}
+		if (error != Z_STREAM_END) {
+			throw bsa::compression_error(bsa::compression_error::library::zlib, error);
+		}
+
+		return a_out.size_bytes() - outsz - stream.avail_out;
+#endif
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+
+#include "bsa/fwd.hpp"
+
+namespace bsa::detail
+{
+	// the zlib level to compress with for a_preset, where a_normal is the level the official
+	// tools use for the format being written
+	[[nodiscard]] auto zlib_level(compression_preset a_preset, int a_normal) noexcept -> int;
+
+	// compresses a_in into a_out as a zlib stream, and returns the size of the stream
+	// the output is identical to deflating a_in with a freshly initialized stream, but each thread
+	// keeps a stream around for every set of parameters it has used, and resets it between calls
+	// when built with BSA_USE_LIBDEFLATE, libdeflate compresses instead wherever it can, which
+	// produces a different (but equally valid) stream
+	[[nodiscard]] auto zlib_compress(
+		std::span<const std::byte> a_in,
+		std::span<std::byte> a_out,
+		int a_level,
+		int a_windowBits,
+		int a_memLevel)
+		-> std::size_t;
+
+	// decompresses the zlib stream in a_in into a_out, and returns the decompressed size
+	// fails the same way uncompress does, but each thread reuses a single stream between calls,
+	// or a single libdeflate decompressor when built with BSA_USE_LIBDEFLATE
+	[[nodiscard]] auto zlib_decompress(
+		std::span<const std::byte> a_in,
+		std::span<std::byte> a_out)
+		-> std::size_t;
+}
@@ -5,21 +5,25 @@
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
-#include <limits>
+#include <memory>
 #include <optional>
 #include <span>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 #include <binary_io/any_stream.hpp>
 #include <binary_io/file_stream.hpp>
+#include <binary_io/memory_stream.hpp>
 #include <lz4.h>
 #include <lz4hc.h>
 #include <zlib.h>
 
 #include <DirectXTex.h>
 
+#include "bsa/detail/zlib.hpp"
+
 namespace bsa::fo4
 {
 	namespace detail
@@ -244,92 +248,6 @@ namespace bsa::fo4
 
 	namespace hashing
 	{
-		namespace
-		{
-			struct split_t
-			{
-				std::string_view parent;
-				std::string_view stem;
-				std::string_view extension;
-			};
-
-			[[nodiscard]] auto split_path(std::string_view a_path) noexcept
-				-> split_t
-			{
-				const auto find = [&](char a_ch) noexcept {
-					const auto pos = a_path.find_last_of(a_ch);
-					return pos != std::string_view::npos ?
-					           std::optional{ pos } :
-					           std::nullopt;
-				};
-
-				split_t result;
-				const auto pstem = find('\\');
-				const auto pextension = find('.');
-
-				if (pstem) {
-					result.parent = a_path.substr(0, *pstem);
-				}
-
-				if (pextension) {
-					result.extension = a_path.substr(*pextension + 1);  // don't include '.'
-				}
-
-				const auto first = pstem ? *pstem + 1 : 0;
-				const auto last = pextension ?
-				                      *pextension - first :
-				                      pextension.value_or(std::string_view::npos);
-				result.stem = a_path.substr(first, last);
-
-				return result;
-			}
-
-			[[nodiscard]] auto crc32(std::string_view a_string) noexcept
-				-> std::uint32_t
-			{
-				constexpr std::array<std::uint32_t, 256> lut = {
-					0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA, 0x076DC419, 0x706AF48F, 0xE963A535, 0x9E6495A3,
-					0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988, 0x09B64C2B, 0x7EB17CBD, 0xE7B82D07, 0x90BF1D91,
-					0x1DB71064, 0x6AB020F2, 0xF3B97148, 0x84BE41DE, 0x1ADAD47D, 0x6DDDE4EB, 0xF4D4B551, 0x83D385C7,
-					0x136C9856, 0x646BA8C0, 0xFD62F97A, 0x8A65C9EC, 0x14015C4F, 0x63066CD9, 0xFA0F3D63, 0x8D080DF5,
-					0x3B6E20C8, 0x4C69105E, 0xD56041E4, 0xA2677172, 0x3C03E4D1, 0x4B04D447, 0xD20D85FD, 0xA50AB56B,
-					0x35B5A8FA, 0x42B2986C, 0xDBBBC9D6, 0xACBCF940, 0x32D86CE3, 0x45DF5C75, 0xDCD60DCF, 0xABD13D59,
-					0x26D930AC, 0x51DE003A, 0xC8D75180, 0xBFD06116, 0x21B4F4B5, 0x56B3C423, 0xCFBA9599, 0xB8BDA50F,
-					0x2802B89E, 0x5F058808, 0xC60CD9B2, 0xB10BE924, 0x2F6F7C87, 0x58684C11, 0xC1611DAB, 0xB6662D3D,
-					0x76DC4190, 0x01DB7106, 0x98D220BC, 0xEFD5102A, 0x71B18589, 0x06B6B51F, 0x9FBFE4A5, 0xE8B8D433,
-					0x7807C9A2, 0x0F00F934, 0x9609A88E, 0xE10E9818, 0x7F6A0DBB, 0x086D3D2D, 0x91646C97, 0xE6635C01,
-					0x6B6B51F4, 0x1C6C6162, 0x856530D8, 0xF262004E, 0x6C0695ED, 0x1B01A57B, 0x8208F4C1, 0xF50FC457,
-					0x65B0D9C6, 0x12B7E950, 0x8BBEB8EA, 0xFCB9887C, 0x62DD1DDF, 0x15DA2D49, 0x8CD37CF3, 0xFBD44C65,
-					0x4DB26158, 0x3AB551CE, 0xA3BC0074, 0xD4BB30E2, 0x4ADFA541, 0x3DD895D7, 0xA4D1C46D, 0xD3D6F4FB,
-					0x4369E96A, 0x346ED9FC, 0xAD678846, 0xDA60B8D0, 0x44042D73, 0x33031DE5, 0xAA0A4C5F, 0xDD0D7CC9,
-					0x5005713C, 0x270241AA, 0xBE0B1010, 0xC90C2086, 0x5768B525, 0x206F85B3, 0xB966D409, 0xCE61E49F,
-					0x5EDEF90E, 0x29D9C998, 0xB0D09822, 0xC7D7A8B4, 0x59B33D17, 0x2EB40D81, 0xB7BD5C3B, 0xC0BA6CAD,
-					0xEDB88320, 0x9ABFB3B6, 0x03B6E20C, 0x74B1D29A, 0xEAD54739, 0x9DD277AF, 0x04DB2615, 0x73DC1683,
-					0xE3630B12, 0x94643B84, 0x0D6D6A3E, 0x7A6A5AA8, 0xE40ECF0B, 0x9309FF9D, 0x0A00AE27, 0x7D079EB1,
-					0xF00F9344, 0x8708A3D2, 0x1E01F268, 0x6906C2FE, 0xF762575D, 0x806567CB, 0x196C3671, 0x6E6B06E7,
-					0xFED41B76, 0x89D32BE0, 0x10DA7A5A, 0x67DD4ACC, 0xF9B9DF6F, 0x8EBEEFF9, 0x17B7BE43, 0x60B08ED5,
-					0xD6D6A3E8, 0xA1D1937E, 0x38D8C2C4, 0x4FDFF252, 0xD1BB67F1, 0xA6BC5767, 0x3FB506DD, 0x48B2364B,
-					0xD80D2BDA, 0xAF0A1B4C, 0x36034AF6, 0x41047A60, 0xDF60EFC3, 0xA867DF55, 0x316E8EEF, 0x4669BE79,
-					0xCB61B38C, 0xBC66831A, 0x256FD2A0, 0x5268E236, 0xCC0C7795, 0xBB0B4703, 0x220216B9, 0x5505262F,
-					0xC5BA3BBE, 0xB2BD0B28, 0x2BB45A92, 0x5CB36A04, 0xC2D7FFA7, 0xB5D0CF31, 0x2CD99E8B, 0x5BDEAE1D,
-					0x9B64C2B0, 0xEC63F226, 0x756AA39C, 0x026D930A, 0x9C0906A9, 0xEB0E363F, 0x72076785, 0x05005713,
-					0x95BF4A82, 0xE2B87A14, 0x7BB12BAE, 0x0CB61B38, 0x92D28E9B, 0xE5D5BE0D, 0x7CDCEFB7, 0x0BDBDF21,
-					0x86D3D2D4, 0xF1D4E242, 0x68DDB3F8, 0x1FDA836E, 0x81BE16CD, 0xF6B9265B, 0x6FB077E1, 0x18B74777,
-					0x88085AE6, 0xFF0F6A70, 0x66063BCA, 0x11010B5C, 0x8F659EFF, 0xF862AE69, 0x616BFFD3, 0x166CCF45,
-					0xA00AE278, 0xD70DD2EE, 0x4E048354, 0x3903B3C2, 0xA7672661, 0xD06016F7, 0x4969474D, 0x3E6E77DB,
-					0xAED16A4A, 0xD9D65ADC, 0x40DF0B66, 0x37D83BF0, 0xA9BCAE53, 0xDEBB9EC5, 0x47B2CF7F, 0x30B5FFE9,
-					0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6, 0xBAD03605, 0xCDD70693, 0x54DE5729, 0x23D967BF,
-					0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94, 0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
-				};
-
-				std::uint32_t result = 0;
-				for (const auto c : a_string) {
-					result = (result >> 8u) ^ lut[(result ^ static_cast<unsigned char>(c)) & 0xFFu];
-				}
-				return result;
-			}
-		}
-
 		auto operator>>(
 			detail::istream_t& a_in,
 			hash& a_hash)
@@ -351,35 +269,44 @@ namespace bsa::fo4
 		hash hash_file_in_place(std::string& a_path) noexcept
 		{
 			detail::normalize_path(a_path);
-			const auto pieces = split_path(a_path);
-
-			hash h;
-			h.directory = crc32(pieces.parent);
-			h.file = crc32(pieces.stem);
+			return detail::hash_normalized(a_path);
+		}
 
-			const auto len = std::min<std::size_t>(pieces.extension.length(), 4u);
-			for (std::size_t i = 0; i < len; ++i) {
-				h.extension |=
-					std::uint32_t{ static_cast<unsigned char>(pieces.extension[i]) }
-					<< i * 8u;
-			}
+		hash hash_file(std::string_view a_path) noexcept
+		{
+			std::array<char, detail::max_path> buffer;
+			return detail::hash_normalized(detail::normalize_path(a_path, buffer));
+		}
 
-			return h;
+		void hash_files(
+			std::span<const std::string_view> a_paths,
+			std::span<hash> a_hashes,
+			const executor& a_executor)
+		{
+			detail::hash_batch(a_paths, a_hashes, a_executor, [](std::string_view a_path) noexcept {
+				return hash_file(a_path);
+			});
 		}
 	}
 
-	std::size_t chunk::compress_into_lz4(std::span<std::byte> a_out) const
+	std::size_t chunk::compress_into_lz4(
+		std::span<std::byte> a_out,
+		compression_preset a_preset) const
 	{
 		assert(!this->compressed());
 		assert(a_out.size_bytes() >= this->compress_bound(compression_format::lz4));
 
 		const auto in = this->as_bytes();
-		const auto result = ::LZ4_compress_HC(
-			reinterpret_cast<const char*>(in.data()),
-			reinterpret_cast<char*>(a_out.data()),
-			static_cast<int>(in.size_bytes()),
-			static_cast<int>(a_out.size_bytes()),
-			12);
+		const auto src = reinterpret_cast<const char*>(in.data());
+		const auto dst = reinterpret_cast<char*>(a_out.data());
+		const auto srcSize = static_cast<int>(in.size_bytes());
+		const auto dstCapacity = static_cast<int>(a_out.size_bytes());
+
+		// the official tools already compress at hc's maximum level, so normal and max are the same
+		const auto result =
+			a_preset == compression_preset::fast ?
+				::LZ4_compress_default(src, dst, srcSize, dstCapacity) :
+				::LZ4_compress_HC(src, dst, srcSize, dstCapacity, LZ4HC_CLEVEL_MAX);
 		if (result == 0) {
 			throw bsa::compression_error(bsa::compression_error::library::lz4, result);
 		}
@@ -396,52 +323,7 @@ namespace bsa::fo4
 		assert(!this->compressed());
 		assert(a_out.size_bytes() >= this->compress_bound(compression_format::zip));
 
-		::z_stream stream = {};
-		if (const auto result = deflateInit2(
-				&stream,
-				a_level,
-				Z_DEFLATED,
-				a_windowBits,
-				a_memLevel,
-				Z_DEFAULT_STRATEGY);
-			result != Z_OK) {
-			throw bsa::compression_error(bsa::compression_error::library::zlib, result);
-		}
-
-		const auto in = this->as_bytes();
-
-		stream.next_out = reinterpret_cast<::Bytef*>(a_out.data());
-		stream.avail_out = 0;
-		stream.next_in = (z_const ::Bytef*)in.data();
-		stream.avail_in = 0;
-
-		auto insz = in.size_bytes();
-		auto outsz = a_out.size_bytes();
-		int error = Z_OK;
-		do {
-			if (stream.avail_out == 0) {
-				stream.avail_out = static_cast<::uInt>(
-					std::min<std::size_t>((std::numeric_limits<::uInt>::max)(), outsz));
-				outsz -= stream.avail_out;
-			}
-
-			if (stream.avail_in == 0) {
-				stream.avail_in = static_cast<::uInt>(
-					std::min<std::size_t>((std::numeric_limits<::uInt>::max)(), insz));
-				insz -= stream.avail_in;
-			}
-
-			error = ::deflate(&stream, insz > 0 ? Z_NO_FLUSH : Z_FINISH);
-		} while (error == Z_OK);
-
-		const auto finalsz = stream.total_out;
-		::deflateEnd(&stream);
-
-		if (error != Z_STREAM_END) {
-			throw bsa::compression_error(bsa::compression_error::library::zlib, error);
-		}
-
-		return finalsz;
+		return detail::zlib_compress(this->as_bytes(), a_out, a_level, a_windowBits, a_memLevel);
 	}
 
 	void chunk::decompress_into_lz4(std::span<std::byte> a_out) const
@@ -471,18 +353,7 @@ namespace bsa::fo4
 		assert(this->compressed());
 		assert(a_out.size_bytes() >= this->decompressed_size());
 
-		const auto in = this->as_bytes();
-		auto outsz = static_cast<::uLong>(a_out.size_bytes());
-
-		const auto result = ::uncompress(
-			reinterpret_cast<::Byte*>(a_out.data()),
-			&outsz,
-			reinterpret_cast<const ::Byte*>(in.data()),
-			static_cast<::uLong>(in.size_bytes()));
-		if (result != Z_OK) {
-			throw bsa::compression_error(bsa::compression_error::library::zlib, result);
-		}
-
+		const auto outsz = detail::zlib_decompress(this->as_bytes(), a_out);
 		if (outsz != this->decompressed_size()) {
 			throw bsa::compression_error(detail::error_code::decompress_size_mismatch);
 		}
@@ -540,18 +411,23 @@ namespace bsa::fo4
 	{
 		switch (a_params.compression_format_) {
 		case compression_format::zip:
-			switch (a_params.compression_level_) {
-			case compression_level::fo4:
-				return this->compress_into_zlib(a_out, Z_DEFAULT_COMPRESSION, MAX_WBITS, 8);
-			case compression_level::fo4_xbox:
-				return this->compress_into_zlib(a_out, Z_BEST_COMPRESSION, 12, 8);
-			case compression_level::sf:
-				return this->compress_into_zlib(a_out, Z_BEST_COMPRESSION, MAX_WBITS, MAX_MEM_LEVEL);
-			default:
-				detail::declare_unreachable();
+			{
+				const auto level = [&](int a_normal) {
+					return detail::zlib_level(a_params.compression_preset_, a_normal);
+				};
+				switch (a_params.compression_level_) {
+				case compression_level::fo4:
+					return this->compress_into_zlib(a_out, level(Z_DEFAULT_COMPRESSION), MAX_WBITS, 8);
+				case compression_level::fo4_xbox:
+					return this->compress_into_zlib(a_out, level(Z_BEST_COMPRESSION), 12, 8);
+				case compression_level::sf:
+					return this->compress_into_zlib(a_out, level(Z_BEST_COMPRESSION), MAX_WBITS, MAX_MEM_LEVEL);
+				default:
+					detail::declare_unreachable();
+				}
 			}
 		case compression_format::lz4:
-			return this->compress_into_lz4(a_out);
+			return this->compress_into_lz4(a_out, a_params.compression_preset_);
 		default:
 			detail::declare_unreachable();
 		}
@@ -634,7 +510,24 @@ namespace bsa::fo4
 		write_sink a_sink,
 		const write_params& a_params) const
 	{
-		auto& out = a_sink.stream();
+		// general files are just their chunks back to back, so the kernel can copy them
+		if (const auto path = a_sink.path(); path && a_params.format_ == format::general) {
+			std::vector<detail::mapped_range> ranges;
+			for (const auto& chunk : *this) {
+				const auto range = chunk.compressed() ? std::nullopt : chunk.mapped_range();
+				if (!range) {
+					break;
+				}
+				ranges.push_back(*range);
+			}
+
+			if (ranges.size() == this->size()) {
+				detail::write_mapped(*path, ranges);
+				return;
+			}
+		}
+
+		detail::ostream_t out{ a_sink.stream() };
 		switch (a_params.format_) {
 		case format::general:
 			this->write_general(out, a_params.compression_format_);
@@ -645,6 +538,7 @@ namespace bsa::fo4
 		default:
 			detail::declare_unreachable();
 		}
+		out.flush();
 	}
 
 	void file::read_directx(
@@ -701,6 +595,7 @@ namespace bsa::fo4
 				chunk.compress({
 					.compression_format_ = a_params.compression_format_,
 					.compression_level_ = a_params.compression_level_,
+					.compression_preset_ = a_params.compression_preset_,
 				});
 			}
 		};
@@ -730,6 +625,7 @@ namespace bsa::fo4
 			chunk.compress({
 				.compression_format_ = a_params.compression_format_,
 				.compression_level_ = a_params.compression_level_,
+				.compression_preset_ = a_params.compression_preset_,
 			});
 		}
 	}
@@ -801,6 +697,70 @@ namespace bsa::fo4
 		}
 	}
 
+	void archive::compress_all(
+		const chunk::compression_params& a_params,
+		const executor& a_executor)
+	{
+		std::vector<file*> files;
+		files.reserve(this->size());
+		for (auto&& f : *this) {
+			files.push_back(&f.second);
+		}
+
+		compress(files, a_params, a_executor);
+	}
+
+	void archive::compress(
+		std::span<file* const> a_files,
+		const chunk::compression_params& a_params,
+		const executor& a_executor)
+	{
+		std::vector<chunk*> chunks;
+		for (const auto f : a_files) {
+			for (auto& c : *f) {
+				if (!c.compressed()) {
+					chunks.push_back(&c);
+				}
+			}
+		}
+
+		detail::parallel_for(a_executor, chunks.size(), [&](std::size_t a_idx) {
+			chunks[a_idx]->compress(a_params);
+		});
+	}
+
+	void archive::decompress_all(
+		compression_format a_format,
+		const executor& a_executor)
+	{
+		std::vector<file*> files;
+		files.reserve(this->size());
+		for (auto&& f : *this) {
+			files.push_back(&f.second);
+		}
+
+		decompress(files, a_format, a_executor);
+	}
+
+	void archive::decompress(
+		std::span<file* const> a_files,
+		compression_format a_format,
+		const executor& a_executor)
+	{
+		std::vector<chunk*> chunks;
+		for (const auto f : a_files) {
+			for (auto& c : *f) {
+				if (c.compressed()) {
+					chunks.push_back(&c);
+				}
+			}
+		}
+
+		detail::parallel_for(a_executor, chunks.size(), [&](std::size_t a_idx) {
+			chunks[a_idx]->decompress(a_format);
+		});
+	}
+
 	auto archive::read(read_source a_source)
 		-> meta_info
 	{
@@ -812,6 +772,14 @@ namespace bsa::fo4
 		}();
 
 		this->clear();
+		_file = in.adopt_file();
+
+		// archives written by this library store entries sorted by hash, so the index is built in
+		// linear time, and only archives from third party packers may need to be sorted first
+		std::vector<std::pair<key_type, mapped_type>> files;
+		files.reserve((std::min)(
+			std::size_t{ header.file_count() },
+			in->rdbuf().size() / detail::constants::chunk_header_size_gnrl));
 		for (std::size_t i = 0, strpos = header.string_table_offset();
 			 i < header.file_count();
 			 ++i) {
@@ -830,43 +798,167 @@ namespace bsa::fo4
 				}
 			}();
 
-			[[maybe_unused]] const auto [it, success] =
-				this->insert(
-					key_type{ hash, name, in },
-					mapped_type{});
-			assert(success);
-
-			this->read_file(it->second, in, header.archive_format());
+			mapped_type f;
+			this->read_file(f, in, header.archive_format());
+			files.emplace_back(key_type{ hash, name, in }, std::move(f));
 		}
+		this->assign(std::move(files));
 
 		return header.make_meta();
 	}
 
+	// how a chunk is stored on disk, as described by its record
+	struct archive::chunk_record_t final
+	{
+		explicit chunk_record_t(const chunk& a_chunk) noexcept :
+			size(a_chunk.size()),
+			decompressedSize(
+				a_chunk.compressed() ?
+					std::optional{ a_chunk.decompressed_size() } :
+					std::nullopt)
+		{}
+
+		std::size_t size{ 0 };
+		std::optional<std::size_t> decompressedSize;  // set if the chunk is compressed
+	};
+
 	void archive::write(
 		write_sink a_sink,
 		const meta_info& a_meta) const
 	{
-		auto& out = a_sink.stream();
+		detail::ostream_t out{ a_sink.stream() };
 
-		auto [header, dataOffset] = make_header(a_meta);
+		const auto [header, dataOffset] = make_header(a_meta);
 		out << header;
+		this->write_file_entries({}, out, a_meta.format_, dataOffset);
 
-		for (const auto& [key, file] : *this) {
-			out << key.hash();
-			this->write_file(file, out, a_meta.format_, dataOffset);
+		for (const auto& file : *this) {
+			for (const auto& chunk : file.second) {
+				out.write_bytes(chunk.as_bytes());
+			}
+		}
+
+		if (a_meta.strings) {
+			for ([[maybe_unused]] const auto& [key, file] : *this) {
+				detail::write_wstring(out, key.name());
+			}
+		}
+
+		out.flush();
+	}
+
+	void archive::write(
+		const std::filesystem::path& a_path,
+		const meta_info& a_meta,
+		const executor& a_executor) const
+	{
+		auto [header, dataOffset] = make_header(a_meta);
+
+		binary_io::any_ostream tableBuffer{ std::in_place_type<binary_io::memory_ostream> };
+		detail::ostream_t tables{ tableBuffer };
+		tables << header;
+		this->write_file_entries({}, tables, a_meta.format_, dataOffset);
+		tables.flush();
+
+		std::vector<std::pair<const chunk*, std::uint64_t>> chunks;
+		for (const auto& file : *this) {
+			for (const auto& chunk : file.second) {
+				chunks.emplace_back(&chunk, dataOffset);
+				dataOffset += chunk.size();
+			}
+		}
+
+		binary_io::any_ostream stringBuffer{ std::in_place_type<binary_io::memory_ostream> };
+		detail::ostream_t strings{ stringBuffer };
+		if (a_meta.strings) {
+			for ([[maybe_unused]] const auto& [key, file] : *this) {
+				detail::write_wstring(strings, key.name());
+			}
 		}
+		strings.flush();
+
+		const auto& stringBytes = stringBuffer.get<binary_io::memory_ostream>().rdbuf();
+		const detail::positional_ostream out{
+			a_path,
+			static_cast<std::size_t>(dataOffset) + stringBytes.size()
+		};
+
+		detail::parallel_for(a_executor, chunks.size(), [&](std::size_t a_idx) {
+			const auto& [chunk, offset] = chunks[a_idx];
+			out.write_bytes(static_cast<std::size_t>(offset), chunk->as_bytes());
+		});
+
+		out.write_bytes(static_cast<std::size_t>(dataOffset), stringBytes);
+		out.write_bytes(0, tableBuffer.get<binary_io::memory_ostream>().rdbuf());
+	}
+
+	void archive::write(
+		write_sink a_sink,
+		const meta_info& a_meta,
+		const chunk::compression_params& a_params,
+		const executor& a_executor) const
+	{
+		auto& stream = a_sink.stream();
+		const auto dataOffset = make_header(a_meta).second;
 
+		std::vector<const chunk*> chunks;
 		for (const auto& file : *this) {
 			for (const auto& chunk : file.second) {
-				out.write_bytes(chunk.as_bytes());
+				chunks.push_back(&chunk);
 			}
 		}
 
+		// chunks are compressed as they are written, so their records are only known once they
+		// have been consumed (which happens in order)
+		std::vector<chunk_record_t> records;
+		records.reserve(chunks.size());
+
+		// the tables don't change size once chunks are compressed, so space is reserved for them
+		// up front, and they are filled in once every chunk has been written
+		const auto start = stream.tell();
+		detail::ostream_t out{ stream };
+		detail::write_zeros(out, static_cast<std::size_t>(dataOffset));
+
+		std::uint64_t dataSize = 0;
+		detail::pipeline<chunk>(
+			a_executor,
+			chunks.size(),
+			[&](std::size_t a_idx) noexcept {
+				return chunks[a_idx]->size();
+			},
+			[&](std::size_t a_idx) {
+				chunk result;
+				if (const auto& data = *chunks[a_idx]; !data.compressed()) {
+					result.set_data(data.as_bytes());
+					result.compress(a_params);
+				}
+				return result;
+			},
+			[&](std::size_t a_idx, const chunk& a_compressed) {
+				const auto& data = *chunks[a_idx];
+				const auto& source = data.compressed() ? data : a_compressed;
+				out.write_bytes(source.as_bytes());
+				records.emplace_back(source);
+				dataSize += source.size();
+			});
+
 		if (a_meta.strings) {
 			for ([[maybe_unused]] const auto& [key, file] : *this) {
 				detail::write_wstring(out, key.name());
 			}
 		}
+		out.flush();
+
+		const auto end = stream.tell();
+		stream.seek_absolute(start);
+		out << detail::header_t{
+			a_meta,
+			this->size(),
+			a_meta.strings ? dataOffset + dataSize : 0u
+		};
+		this->write_file_entries(records, out, a_meta.format_, dataOffset);
+		out.flush();
+		stream.seek_absolute(end);
 	}
 
 	auto archive::make_header(const meta_info& a_meta) const
@@ -979,17 +1071,16 @@ namespace bsa::fo4
 
 	void archive::write_chunk(
 		const chunk& a_chunk,
+		const chunk_record_t& a_record,
 		detail::ostream_t& a_out,
 		format a_format,
 		std::uint64_t& a_dataOffset) const noexcept
 	{
-		const auto size = a_chunk.size();
 		a_out.write(
 			a_dataOffset,
-			static_cast<std::uint32_t>(a_chunk.compressed() ? size : 0u),
-			static_cast<std::uint32_t>(
-				a_chunk.compressed() ? a_chunk.decompressed_size() : size));
-		a_dataOffset += size;
+			static_cast<std::uint32_t>(a_record.decompressedSize ? a_record.size : 0u),
+			static_cast<std::uint32_t>(a_record.decompressedSize.value_or(a_record.size)));
+		a_dataOffset += a_record.size;
 
 		if (a_format == format::directx) {
 			a_out << a_chunk.mips;
@@ -1000,6 +1091,7 @@ namespace bsa::fo4
 
 	void archive::write_file(
 		const file& a_file,
+		std::span<const chunk_record_t> a_records,
 		detail::ostream_t& a_out,
 		format a_format,
 		std::uint64_t& a_dataOffset) const noexcept
@@ -1019,8 +1111,31 @@ namespace bsa::fo4
 			detail::declare_unreachable();
 		}
 
-		for (const auto& chunk : a_file) {
-			this->write_chunk(chunk, a_out, a_format, a_dataOffset);
+		for (std::size_t i = 0; i < a_file.size(); ++i) {
+			const auto& chunk = a_file[i];
+			this->write_chunk(
+				chunk,
+				a_records.empty() ? chunk_record_t{ chunk } : a_records[i],
+				a_out,
+				a_format,
+				a_dataOffset);
+		}
+	}
+
+	void archive::write_file_entries(
+		std::span<const chunk_record_t> a_records,
+		detail::ostream_t& a_out,
+		format a_format,
+		std::uint64_t a_dataOffset) const noexcept
+	{
+		for (const auto& [key, file] : *this) {
+			a_out << key.hash();
+			if (a_records.empty()) {
+				this->write_file(file, {}, a_out, a_format, a_dataOffset);
+			} else {
+				this->write_file(file, a_records.first(file.size()), a_out, a_format, a_dataOffset);
+				a_records = a_records.subspan(file.size());
+			}
 		}
 	}
 }
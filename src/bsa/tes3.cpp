@@ -1,15 +1,17 @@
 #include "bsa/tes3.hpp"
 
+#include <algorithm>
 #include <array>
-#include <bit>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
 #include <filesystem>
 #include <limits>
+#include <memory>
 #include <string>
 #include <string_view>
 #include <utility>
+#include <vector>
 
 #include <binary_io/any_stream.hpp>
 #include <binary_io/file_stream.hpp>
@@ -133,24 +135,23 @@ namespace bsa::tes3
 		hash hash_file_in_place(std::string& a_path) noexcept
 		{
 			detail::normalize_path(a_path);
-			hash h;
-
-			const std::size_t midpoint = a_path.length() / 2u;
-			std::size_t i = 0;
-			for (; i < midpoint; ++i) {
-				// rotate between first 4 bytes
-				h.lo ^= std::uint32_t{ static_cast<unsigned char>(a_path[i]) }
-				        << ((i % 4u) * 8u);
-			}
+			return detail::hash_normalized(a_path);
+		}
 
-			for (std::uint32_t rot = 0; i < a_path.length(); ++i) {
-				// rotate between last 4 bytes
-				rot = std::uint32_t{ static_cast<unsigned char>(a_path[i]) }
-				      << (((i - midpoint) % 4u) * 8u);
-				h.hi = std::rotr(h.hi ^ rot, static_cast<int>(rot));
-			}
+		hash hash_file(std::string_view a_path) noexcept
+		{
+			std::array<char, detail::max_path> buffer;
+			return detail::hash_normalized(detail::normalize_path(a_path, buffer));
+		}
 
-			return h;
+		void hash_files(
+			std::span<const std::string_view> a_paths,
+			std::span<hash> a_hashes,
+			const executor& a_executor)
+		{
+			detail::hash_batch(a_paths, a_hashes, a_executor, [](std::string_view a_path) noexcept {
+				return hash_file(a_path);
+			});
 		}
 	}
 
@@ -163,8 +164,13 @@ namespace bsa::tes3
 
 	void file::write(write_sink a_sink) const
 	{
-		auto& out = a_sink.stream();
-		out.write_bytes(this->as_bytes());
+		const auto path = a_sink.path();
+		if (const auto range = this->mapped_range(); path && range) {
+			detail::write_mapped(*path, { &*range, 1 });
+		} else {
+			auto& out = a_sink.stream();
+			out.write_bytes(this->as_bytes());
+		}
 	}
 
 	struct archive::offsets_t final
@@ -197,6 +203,22 @@ namespace bsa::tes3
 		}
 	};
 
+	// everything needed to write an archive, computed in one traversal of it: the header, and the
+	// offset of every file's name and data
+	struct archive::layout_t final
+	{
+		struct file_t final
+		{
+			const_iterator entry;
+			std::size_t name{ 0 };  // offset of the file's name, relative to the name table
+			std::size_t data{ 0 };  // offset of the file's data, relative to the data block
+		};
+
+		detail::header_t header;
+		std::size_t hashOffset{ 0 };  // as written in the header
+		std::vector<file_t> files;
+	};
+
 	void archive::read(read_source a_source)
 	{
 		auto& in = a_source.stream();
@@ -216,34 +238,41 @@ namespace bsa::tes3
 			detail::offsetof_file_data(header)
 		};
 
+		_file = in.adopt_file();
+		if (in.deep_copy() && offsets.hashes > offsets.names) {
+			in.names()->size_hint((std::min)(offsets.hashes - offsets.names, in->rdbuf().size()));
+		}
+
+		// files are stored in ascending order of their hash, so the index is built in linear time
+		std::vector<std::pair<key_type, mapped_type>> files;
+		files.reserve((std::min)(
+			std::size_t{ header.file_count() },
+			in->rdbuf().size() / detail::constants::hash_size));
 		for (std::size_t i = 0; i < header.file_count(); ++i) {
-			this->read_file(in, offsets, i);
+			files.push_back(this->read_file(in, offsets, i));
 		}
+		this->assign(std::move(files));
 	}
 
 	bool archive::verify_offsets() const noexcept
 	{
-		offsets_t total;
-		offsets_t last;
-
+		// the same offsets make_layout computes, without recording them for every file
+		std::size_t name = 0;
+		std::size_t data = 0;
+		std::size_t lastName = 0;
+		std::size_t lastData = 0;
 		for (const auto& [key, file] : *this) {
-			last.nameOffsets += key.name().length() +
-			                    1u;  // include null terminator
-			last.fileData += file.size();
-
-			total += last;
+			lastName = name;
+			lastData = data;
+			name += key.name().length() +
+			        1u;  // include null terminator
+			data += file.size();
 		}
 
-		total.hashes =
-			detail::constants::header_size +
-			(detail::constants::file_entry_size + 4u) * this->size() +
-			total.nameOffsets;
-		total -= last;
-
 		const std::array offsets{
-			total.nameOffsets,
-			total.hashes,
-			total.fileData
+			lastName,
+			(detail::constants::file_entry_size + 4u) * this->size() + name,
+			lastData
 		};
 		for (const auto offset : offsets) {
 			if (offset > std::numeric_limits<std::uint32_t>::max()) {
@@ -255,37 +284,51 @@ namespace bsa::tes3
 
 	void archive::write(write_sink a_sink) const
 	{
-		auto& out = a_sink.stream();
+		detail::ostream_t out{ a_sink.stream() };
 
-		out << this->make_header();
+		const auto layout = this->make_layout();
+		out << layout.header;
 
-		this->write_file_entries(out);
-		this->write_file_name_offsets(out);
-		this->write_file_names(out);
-		this->write_file_hashes(out);
-		this->write_file_data(out);
+		this->write_file_entries(layout, out);
+		this->write_file_name_offsets(layout, out);
+		this->write_file_names(layout, out);
+		this->write_file_hashes(layout, out);
+		this->write_file_data(layout, out);
+		out.flush();
 	}
 
-	auto archive::make_header() const noexcept
-		-> detail::header_t
+	auto archive::make_layout() const
+		-> layout_t
 	{
-		std::size_t offset =
-			(detail::constants::file_entry_size + 4u) * this->size();
-		for ([[maybe_unused]] const auto& [key, file] : *this) {
-			offset += key.name().length() +
-			          1u;  // include null terminator
+		layout_t layout;
+		layout.files.reserve(this->size());
+
+		std::size_t name = 0;
+		std::size_t data = 0;
+		for (auto it = this->begin(); it != this->end(); ++it) {
+			const auto& [key, file] = *it;
+			layout.files.push_back({ it, name, data });
+			name += key.name().length() +
+			        1u;  // include null terminator
+			data += file.size();
 		}
 
-		return {
-			static_cast<std::uint32_t>(offset),
+		layout.hashOffset =
+			(detail::constants::file_entry_size + 4u) * this->size() +
+			name;
+		layout.header = {
+			static_cast<std::uint32_t>(layout.hashOffset),
 			static_cast<std::uint32_t>(this->size())
 		};
+
+		return layout;
 	}
 
-	void archive::read_file(
+	auto archive::read_file(
 		detail::istream_t& a_in,
 		const offsets_t& a_offsets,
 		std::size_t a_idx)
+		-> std::pair<key_type, mapped_type>
 	{
 		const auto hash = [&]() {
 			const detail::restore_point _{ a_in };
@@ -304,58 +347,60 @@ namespace bsa::tes3
 			return detail::read_zstring(a_in);
 		}();
 
-		[[maybe_unused]] const auto [it, success] =
-			this->insert(
-				key_type{ hash, name, a_in },
-				mapped_type{});
-		assert(success);
-
 		const auto [size, offset] = a_in->read<std::uint32_t, std::uint32_t>();
 
 		const detail::restore_point _{ a_in };
 		a_in->seek_absolute(a_offsets.fileData + offset);
-		it->second.set_data(a_in->read_bytes(size), a_in);
+		mapped_type f;
+		f.set_data(a_in->read_bytes(size), a_in);
+
+		return { key_type{ hash, name, a_in }, std::move(f) };
 	}
 
-	void archive::write_file_entries(detail::ostream_t& a_out) const noexcept
+	void archive::write_file_entries(
+		const layout_t& a_layout,
+		detail::ostream_t& a_out) const noexcept
 	{
-		std::uint32_t offset = 0;
-		for ([[maybe_unused]] const auto& [key, file] : *this) {
-			const auto size = static_cast<std::uint32_t>(file.size());
-			a_out.write(size, offset);
-			offset += size;
+		for (const auto& file : a_layout.files) {
+			a_out.write(
+				static_cast<std::uint32_t>(file.entry->second.size()),
+				static_cast<std::uint32_t>(file.data));
 		}
 	}
 
-	void archive::write_file_name_offsets(detail::ostream_t& a_out) const noexcept
+	void archive::write_file_name_offsets(
+		const layout_t& a_layout,
+		detail::ostream_t& a_out) const noexcept
 	{
-		std::uint32_t offset = 0;
-		for ([[maybe_unused]] const auto& [key, file] : *this) {
-			a_out.write(offset);
-			offset += static_cast<std::uint32_t>(
-				key.name().length() +
-				1u);  // include null terminator
+		for (const auto& file : a_layout.files) {
+			a_out.write(static_cast<std::uint32_t>(file.name));
 		}
 	}
 
-	void archive::write_file_names(detail::ostream_t& a_out) const noexcept
+	void archive::write_file_names(
+		const layout_t& a_layout,
+		detail::ostream_t& a_out) const noexcept
 	{
-		for ([[maybe_unused]] const auto& [key, file] : *this) {
-			detail::write_zstring(a_out, key.name());
+		for (const auto& file : a_layout.files) {
+			detail::write_zstring(a_out, file.entry->first.name());
 		}
 	}
 
-	void archive::write_file_hashes(detail::ostream_t& a_out) const noexcept
+	void archive::write_file_hashes(
+		const layout_t& a_layout,
+		detail::ostream_t& a_out) const noexcept
 	{
-		for ([[maybe_unused]] const auto& [key, file] : *this) {
-			a_out << key.hash();
+		for (const auto& file : a_layout.files) {
+			a_out << file.entry->first.hash();
 		}
 	}
 
-	void archive::write_file_data(detail::ostream_t& a_out) const noexcept
+	void archive::write_file_data(
+		const layout_t& a_layout,
+		detail::ostream_t& a_out) const noexcept
 	{
-		for ([[maybe_unused]] const auto& [key, file] : *this) {
-			a_out.write_bytes(file.as_bytes());
+		for (const auto& file : a_layout.files) {
+			a_out.write_bytes(file.entry->second.as_bytes());
 		}
 	}
 }
@@ -8,6 +8,7 @@
 #include <cstdint>
 #include <cstring>
 #include <filesystem>
+#include <iterator>
 #include <limits>
 #include <memory>
 #include <optional>
@@ -35,6 +36,8 @@
 #	include "bsa/detail/binary_reproc.hpp"
 #endif
 
+#include "bsa/detail/zlib.hpp"
+
 namespace bsa::tes4
 {
 	namespace detail
@@ -57,12 +60,48 @@ namespace bsa::tes4
 				return options;
 			}();
 
-			constexpr auto lz4f_preferences = []() noexcept {
+			[[nodiscard]] auto lz4f_preferences(compression_preset a_preset) noexcept
+				-> ::LZ4F_preferences_t
+			{
 				::LZ4F_preferences_t pref = LZ4F_INIT_PREFERENCES;
-				pref.compressionLevel = LZ4HC_CLEVEL_DEFAULT;
+				switch (a_preset) {
+				case compression_preset::fast:
+					pref.compressionLevel = 0;  // lz4's fast (non-hc) compressor
+					break;
+				case compression_preset::normal:
+					pref.compressionLevel = LZ4HC_CLEVEL_DEFAULT;
+					break;
+				case compression_preset::max:
+					pref.compressionLevel = LZ4HC_CLEVEL_MAX;
+					break;
+				default:
+					declare_unreachable();
+				}
 				pref.autoFlush = 1;
 				return pref;
-			}();
+			}
+
+			// creating a context allocates several buffers, and archives are often full of tiny
+			// files, so each thread keeps one around and resets it between files instead
+			[[nodiscard]] auto get_lz4f_dctx()
+				-> ::LZ4F_dctx&
+			{
+				thread_local const auto dctx = []() {
+					::LZ4F_dctx* pdctx = nullptr;
+					if (const auto result = ::LZ4F_createDecompressionContext(&pdctx, LZ4F_VERSION);
+						::LZ4F_isError(result)) {
+						throw bsa::compression_error(bsa::compression_error::library::lz4, result);
+					}
+					return std::unique_ptr<::LZ4F_dctx, decltype(&::LZ4F_freeDecompressionContext)>{
+						pdctx,
+						::LZ4F_freeDecompressionContext
+					};
+				}();
+
+				// a previous file may have failed partway through its frame
+				::LZ4F_resetDecompressionContext(dctx.get());
+				return *dctx;
+			}
 		}
 
 		class header_t final
@@ -253,6 +292,106 @@ namespace bsa::tes4
 				       a_header.file_names_length();
 			}
 
+			// assembles the bytes which precede a file's data on disk: its embedded name, and its
+			// decompressed size
+			void make_data_prefix(
+				std::vector<std::byte>& a_prefix,
+				const detail::header_t& a_header,
+				std::string_view a_directory,
+				std::string_view a_name,
+				const file& a_file)
+			{
+				const auto append = [&](std::string_view a_string) {
+					const auto bytes = std::as_bytes(std::span{ a_string });
+					a_prefix.insert(a_prefix.end(), bytes.begin(), bytes.end());
+				};
+
+				a_prefix.clear();
+				if (a_header.embedded_file_names()) {
+					a_prefix.push_back(static_cast<std::byte>(
+						a_directory.size() +
+						1u +  // directory separator
+						a_name.size()));
+					append(a_directory);
+					a_prefix.push_back(std::byte{ '\\' });
+					append(a_name);
+				}
+
+				if (a_file.compressed()) {
+					const auto size = static_cast<std::uint32_t>(a_file.decompressed_size());
+					for (std::size_t i = 0; i < 4; ++i) {
+						a_prefix.push_back(static_cast<std::byte>(size >> (i * 8u)));
+					}
+				}
+			}
+
+			// the size of a file's record on disk, excluding flags: its data, and the prefixes
+			// which precede it
+			[[nodiscard]] auto record_size(
+				const header_t& a_header,
+				std::string_view a_directory,
+				std::string_view a_name,
+				const file& a_file)
+				-> std::size_t
+			{
+				auto size = a_file.size();
+				if (a_header.embedded_file_names()) {
+					size +=
+						1u +  // prefixed byte length
+						a_directory.length() +
+						1u +  // directory separator
+						a_name.length();
+				}
+				if (a_file.compressed()) {
+					size += 4u;  // decompressed size
+				}
+				return size;
+			}
+
+			// i legitimately have no idea how they sort hashes in the xbox format
+			// it simply defies all reason
+			[[nodiscard]] auto xbox_sort_key(const hashing::hash& a_hash) noexcept
+				-> std::uint64_t
+			{
+				return binary_io::endian::reverse(a_hash.numeric());
+			}
+
+			// a stable lsd radix sort on the first element of each pair, one byte at a time
+			template <class T>
+			void radix_sort(std::vector<std::pair<std::uint64_t, T>>& a_values) noexcept
+			{
+				if (a_values.size() < 2) {
+					return;
+				}
+
+				std::vector<std::pair<std::uint64_t, T>> scratch(a_values.size());
+				for (std::size_t shift = 0; shift < 64; shift += 8) {
+					const auto digit = [&](std::uint64_t a_key) noexcept {
+						return static_cast<std::size_t>((a_key >> shift) & 0xFFu);
+					};
+
+					std::array<std::size_t, 0x100> offsets{};
+					for (const auto& value : a_values) {
+						++offsets[digit(value.first)];
+					}
+
+					// every key shares this byte, so this pass would not move anything
+					if (offsets[digit(a_values.front().first)] == a_values.size()) {
+						continue;
+					}
+
+					std::size_t sum = 0;
+					for (auto& offset : offsets) {
+						sum += std::exchange(offset, sum);
+					}
+
+					for (const auto& value : a_values) {
+						scratch[offsets[digit(value.first)]++] = value;
+					}
+					a_values.swap(scratch);
+				}
+			}
+
 #ifdef BSA_SUPPORT_XMEM
 			template <class CharT>
 			[[nodiscard]] auto string_split(
@@ -397,20 +536,6 @@ namespace bsa::tes4
 
 	namespace hashing
 	{
-		namespace
-		{
-			[[nodiscard]] auto crc32(std::span<const std::byte> a_bytes)
-				-> std::uint32_t
-			{
-				constexpr auto constant = std::uint32_t{ 0x1003Fu };
-				std::uint32_t crc = 0;
-				for (const auto c : a_bytes) {
-					crc = static_cast<std::uint8_t>(c) + crc * constant;
-				}
-				return crc;
-			}
-		}
-
 		void hash::read(
 			detail::istream_t& a_in,
 			std::endian a_endian)
@@ -440,94 +565,48 @@ namespace bsa::tes4
 		hash hash_directory_in_place(std::string& a_path) noexcept
 		{
 			detail::normalize_path(a_path);
-			const std::span<const std::byte> view{
-				reinterpret_cast<const std::byte*>(a_path.data()),
-				a_path.size()
-			};
-
-			hash h;
-
-			switch (std::min<std::size_t>(view.size(), 3)) {
-			case 3:
-				h.last2 = static_cast<std::uint8_t>(*(view.end() - 2));
-				[[fallthrough]];
-			case 2:
-			case 1:
-				h.last = static_cast<std::uint8_t>(view.back());
-				h.first = static_cast<std::uint8_t>(view.front());
-				[[fallthrough]];
-			default:
-				break;
-			}
+			return detail::hash_directory_normalized(a_path);
+		}
 
-			h.length = static_cast<std::uint8_t>(view.size());
-			if (h.length > 3) {
-				// skip first and last two chars -> already processed
-				h.crc = crc32(view.subspan(1, view.size() - 3));
-			}
+		hash hash_directory(std::string_view a_path) noexcept
+		{
+			std::array<char, detail::max_path> buffer;
+			return detail::hash_directory_normalized(detail::normalize_path(a_path, buffer));
+		}
 
-			return h;
+		void hash_directories(
+			std::span<const std::string_view> a_paths,
+			std::span<hash> a_hashes,
+			const executor& a_executor)
+		{
+			detail::hash_batch(a_paths, a_hashes, a_executor, [](std::string_view a_path) noexcept {
+				return hash_directory(a_path);
+			});
 		}
 
 		hash hash_file_in_place(std::string& a_path) noexcept
 		{
-			constexpr std::array lut{
-				make_four_cc(""sv),
-				make_four_cc(".nif"sv),
-				make_four_cc(".kf"sv),
-				make_four_cc(".dds"sv),
-				make_four_cc(".wav"sv),
-				make_four_cc(".adp"sv),
-			};
-
 			detail::normalize_path(a_path);
 			if (const auto pos = a_path.find_last_of('\\'); pos != std::string::npos) {
-				a_path = a_path.substr(pos + 1);
+				a_path.erase(0, pos + 1);
 			}
-			const std::string_view pview{ a_path };
-
-			const auto [stem, extension] = [&]() noexcept
-				-> std::pair<std::string_view, std::string_view> {
-				const auto split = pview.find_last_of('.');
-				if (split != std::string_view::npos) {
-					return {
-						pview.substr(0, split),
-						pview.substr(split)
-					};
-				} else {
-					return {
-						pview,
-						""sv
-					};
-				}
-			}();
+			return detail::hash_file_normalized(a_path);
+		}
 
-			if (!stem.empty() &&
-				stem.length() < 260 &&
-				extension.length() < 16) {
-				auto h = [&]() noexcept {
-					std::string temp{ stem };
-					return hash_directory(temp);
-				}();
-				h.crc += crc32({ //
-					reinterpret_cast<const std::byte*>(extension.data()),
-					extension.size() });
-
-				const auto it = std::find(
-					lut.begin(),
-					lut.end(),
-					make_four_cc(extension));
-				if (it != lut.end()) {
-					const auto i = static_cast<std::uint8_t>(it - lut.begin());
-					h.first += 32u * (i & 0xFCu);
-					h.last += (i & 0xFEu) << 6u;
-					h.last2 += i << 7u;
-				}
+		hash hash_file(std::string_view a_path) noexcept
+		{
+			std::array<char, detail::max_path> buffer;
+			return detail::hash_file_normalized(detail::normalize_path(a_path, buffer));
+		}
 
-				return h;
-			} else {
-				return {};
-			}
+		void hash_files(
+			std::span<const std::string_view> a_paths,
+			std::span<hash> a_hashes,
+			const executor& a_executor)
+		{
+			detail::hash_batch(a_paths, a_hashes, a_executor, [](std::string_view a_path) noexcept {
+				return hash_file(a_path);
+			});
 		}
 	}
 
@@ -558,7 +637,10 @@ namespace bsa::tes4
 			           ::compressBound(static_cast<::uLong>(this->size()));
 		case 105:
 			assert(a_params.compression_codec_ == compression_codec::normal);
-			return ::LZ4F_compressFrameBound(this->size(), &detail::lz4f_preferences);
+			{
+				const auto preferences = detail::lz4f_preferences(a_params.compression_preset_);
+				return ::LZ4F_compressFrameBound(this->size(), &preferences);
+			}
 		default:
 			detail::declare_unreachable();
 		}
@@ -572,14 +654,14 @@ namespace bsa::tes4
 		switch (detail::to_underlying(a_params.version_)) {
 		case 103:
 			assert(a_params.compression_codec_ == compression_codec::normal);
-			return this->compress_into_zlib(a_out);
+			return this->compress_into_zlib(a_out, a_params.compression_preset_);
 		case 104:
 			return a_params.compression_codec_ == compression_codec::xmem ?
 			           this->compress_into_xmem(a_out) :
-			           this->compress_into_zlib(a_out);
+			           this->compress_into_zlib(a_out, a_params.compression_preset_);
 		case 105:
 			assert(a_params.compression_codec_ == compression_codec::normal);
-			return this->compress_into_lz4(a_out);
+			return this->compress_into_lz4(a_out, a_params.compression_preset_);
 		default:
 			detail::declare_unreachable();
 		}
@@ -631,6 +713,7 @@ namespace bsa::tes4
 			this->compress({
 				.version_ = a_params.version_,
 				.compression_codec_ = a_params.compression_codec_,
+				.compression_preset_ = a_params.compression_preset_,
 			});
 		}
 	}
@@ -639,7 +722,8 @@ namespace bsa::tes4
 		write_sink a_sink,
 		const write_params& a_params) const
 	{
-		auto& out = a_sink.stream();
+		const auto path = a_sink.path();
+		const auto range = this->mapped_range();
 		if (this->compressed()) {
 			std::vector<std::byte> buffer;
 			buffer.resize(this->decompressed_size());
@@ -649,9 +733,11 @@ namespace bsa::tes4
 					.version_ = a_params.version_,
 					.compression_codec_ = a_params.compression_codec_,
 				});
-			out.write_bytes(buffer);
+			a_sink.stream().write_bytes(buffer);
+		} else if (path && range) {
+			detail::write_mapped(*path, { &*range, 1 });
 		} else {
-			out.write_bytes(this->as_bytes());
+			a_sink.stream().write_bytes(this->as_bytes());
 		}
 	}
 
@@ -683,20 +769,27 @@ namespace bsa::tes4
 #endif
 	}
 
-	auto file::compress_into_lz4(std::span<std::byte> a_out) const
+	auto file::compress_into_lz4(
+		std::span<std::byte> a_out,
+		compression_preset a_preset) const
 		-> std::size_t
 	{
 		assert(!this->compressed());
-		assert(a_out.size_bytes() >= this->compress_bound({ .version_ = version::sse }));
+		assert(a_out.size_bytes() >=
+			   this->compress_bound({
+				   .version_ = version::sse,
+				   .compression_preset_ = a_preset,
+			   }));
 
 		const auto in = this->as_bytes();
+		const auto preferences = detail::lz4f_preferences(a_preset);
 
 		const auto result = ::LZ4F_compressFrame(
 			a_out.data(),
 			a_out.size_bytes(),
 			in.data(),
 			in.size_bytes(),
-			&detail::lz4f_preferences);
+			&preferences);
 		if (::LZ4F_isError(result)) {
 			throw bsa::compression_error(bsa::compression_error::library::lz4, result);
 		}
@@ -745,25 +838,21 @@ namespace bsa::tes4
 #endif
 	}
 
-	auto file::compress_into_zlib(std::span<std::byte> a_out) const
+	auto file::compress_into_zlib(
+		std::span<std::byte> a_out,
+		compression_preset a_preset) const
 		-> std::size_t
 	{
 		assert(!this->compressed());
 		assert(a_out.size_bytes() >= this->compress_bound({ .version_ = version::tes4 }));
 
-		const auto in = this->as_bytes();
-		auto outsz = static_cast<::uLong>(a_out.size_bytes());
-
-		const auto result = ::compress(
-			reinterpret_cast<::Byte*>(a_out.data()),
-			&outsz,
-			reinterpret_cast<const ::Byte*>(in.data()),
-			static_cast<::uLong>(in.size_bytes()));
-		if (result != Z_OK) {
-			throw bsa::compression_error(bsa::compression_error::library::zlib, result);
-		}
-
-		return static_cast<std::size_t>(outsz);
+		// the same parameters compress uses
+		return detail::zlib_compress(
+			this->as_bytes(),
+			a_out,
+			detail::zlib_level(a_preset, Z_DEFAULT_COMPRESSION),
+			MAX_WBITS,
+			8);
 	}
 
 	void file::decompress_into_lz4(std::span<std::byte> a_out) const
@@ -771,16 +860,7 @@ namespace bsa::tes4
 		assert(this->compressed());
 		assert(a_out.size_bytes() >= this->decompressed_size());
 
-		::LZ4F_dctx* pdctx = nullptr;
-		if (const auto result = ::LZ4F_createDecompressionContext(&pdctx, LZ4F_VERSION);
-			::LZ4F_isError(result)) {
-			throw bsa::compression_error(bsa::compression_error::library::lz4, result);
-		}
-		std::unique_ptr<::LZ4F_dctx, decltype(&::LZ4F_freeDecompressionContext)> dctx{
-			pdctx,
-			::LZ4F_freeDecompressionContext
-		};
-
+		auto& dctx = detail::get_lz4f_dctx();
 		const auto in = this->as_bytes();
 
 		std::size_t insz = 0;
@@ -794,7 +874,7 @@ namespace bsa::tes4
 			outptr += outsz;
 			outsz = static_cast<std::size_t>(std::to_address(a_out.end()) - outptr);
 			result = ::LZ4F_decompress(
-				dctx.get(),
+				&dctx,
 				outptr,
 				&outsz,
 				inptr,
@@ -856,27 +936,77 @@ namespace bsa::tes4
 		assert(this->compressed());
 		assert(a_out.size_bytes() >= this->decompressed_size());
 
-		const auto in = this->as_bytes();
-		auto outsz = static_cast<::uLong>(a_out.size_bytes());
-
-		const auto result = ::uncompress(
-			reinterpret_cast<::Byte*>(a_out.data()),
-			&outsz,
-			reinterpret_cast<const ::Byte*>(in.data()),
-			static_cast<::uLong>(in.size_bytes()));
-		if (result != Z_OK) {
-			throw bsa::compression_error(bsa::compression_error::library::zlib, result);
-		}
-
+		const auto outsz = detail::zlib_decompress(this->as_bytes(), a_out);
 		if (outsz != this->decompressed_size()) {
 			throw bsa::compression_error(detail::error_code::decompress_size_mismatch);
 		}
 	}
 
-	auto archive::read(read_source a_source)
+	void archive::compress_all(
+		const file::compression_params& a_params,
+		const executor& a_executor)
+	{
+		std::vector<file*> files;
+		for (auto&& dir : *this) {
+			for (auto&& f : dir.second) {
+				if (!f.second.compressed()) {
+					files.push_back(&f.second);
+				}
+			}
+		}
+
+		compress(files, a_params, a_executor);
+	}
+
+	void archive::compress(
+		std::span<file* const> a_files,
+		const file::compression_params& a_params,
+		const executor& a_executor)
+	{
+		detail::parallel_for(a_executor, a_files.size(), [&](std::size_t a_idx) {
+			auto& f = *a_files[a_idx];
+			if (!f.compressed()) {
+				f.compress(a_params);
+			}
+		});
+	}
+
+	void archive::decompress_all(
+		const file::compression_params& a_params,
+		const executor& a_executor)
+	{
+		std::vector<file*> files;
+		for (auto&& dir : *this) {
+			for (auto&& f : dir.second) {
+				if (f.second.compressed()) {
+					files.push_back(&f.second);
+				}
+			}
+		}
+
+		decompress(files, a_params, a_executor);
+	}
+
+	void archive::decompress(
+		std::span<file* const> a_files,
+		const file::compression_params& a_params,
+		const executor& a_executor)
+	{
+		detail::parallel_for(a_executor, a_files.size(), [&](std::size_t a_idx) {
+			auto& f = *a_files[a_idx];
+			if (f.compressed()) {
+				f.decompress(a_params);
+			}
+		});
+	}
+
+	auto archive::read(
+		read_source a_source,
+		read_mode a_mode)
 		-> version
 	{
 		auto& in = a_source.stream();
+		const bool lazy = a_mode == read_mode::lazy && in.shallow_copy();
 
 		const auto header = [&]() {
 			detail::header_t result;
@@ -889,120 +1019,217 @@ namespace bsa::tes4
 		_flags = header.archive_flags();
 		_types = header.archive_types();
 
-		std::size_t namesOffset = detail::offsetof_file_strings(header);
-		std::size_t filesOffset = detail::offsetof_file_entries(header);
-		in->seek_absolute(header.directories_offset());
-		for (std::size_t i = 0; i < header.directory_count(); ++i) {
-			this->read_directory(in, header, filesOffset, namesOffset);
+		_file = in.adopt_file();
+		if (lazy && !_file) {
+			// deferred records are parsed on access, so the mapping has to outlive the read
+			_file = in.file();
 		}
-
-		return static_cast<version>(header.archive_version());
-	}
-
-	bool archive::verify_offsets(version a_version) const noexcept
-	{
-		const auto header = this->make_header(a_version);
-		auto offset = detail::offsetof_file_data(header);
-
-		std::size_t last = 0;
-		for (const auto& dir : *this) {
-			for (const auto& [key, file] : dir.second) {
-				last = key.name().length() +
-				       1u;  // prefixed byte length
-				if (file.compressed()) {
-					last += 4u;
-				}
-				last += file.size();
-				offset += last;
-			}
+		if (in.deep_copy()) {
+			in.names()->size_hint((std::min)(
+				std::size_t{ header.directory_names_length() } + header.file_names_length(),
+				in->rdbuf().size()));
 		}
 
-		offset -= last;
-		return offset <= (std::numeric_limits<std::int32_t>::max)();
-	}
-
-	void archive::write(
-		write_sink a_sink,
-		version a_version) const
-	{
-		auto& out = a_sink.stream();
-
-		const auto header = this->make_header(a_version);
-		out << header;
+		const auto fileNames = [&]() {
+			if (header.file_strings()) {
+				in->seek_absolute(detail::offsetof_file_strings(header));
+				return detail::read_zstrings(in, header.file_count());
+			} else {
+				return std::vector<std::string_view>();
+			}
+		}();
 
-		const auto intermediate = sort_for_write(header.xbox_archive());
+		std::span<const std::string_view> names{ fileNames };
+		std::size_t filesOffset = detail::offsetof_file_entries(header);
+		in->seek_absolute(header.directories_offset());
 
-		this->write_directory_entries(intermediate, out, header);
-		this->write_file_entries(intermediate, out, header);
-		if (header.file_strings()) {
-			this->write_file_names(intermediate, out);
+		// records are stored in ascending order of their hash (unless the archive was built for
+		// the xbox), so the index is usually built in linear time
+		std::vector<std::pair<key_type, mapped_type>> directories;
+		directories.reserve((std::min)(
+			std::size_t{ header.directory_count() },
+			in->rdbuf().size() / detail::constants::directory_entry_size_x86));
+		for (std::size_t i = 0; i < header.directory_count(); ++i) {
+			directories.push_back(this->read_directory(in, header, filesOffset, names, lazy));
 		}
-		this->write_file_data(intermediate, out, header);
+		this->assign(std::move(directories));
+
+		return static_cast<version>(header.archive_version());
 	}
 
-	struct archive::xbox_sort_t final
+	// everything needed to write an archive, computed in one traversal of it: the order in which
+	// directories and files are written, the header, and the offset of every record on disk
+	struct archive::layout_t final
 	{
-		// i legitimately have no idea how they sort hashes in the xbox format
-		// it simply defies all reason
+		struct directory_t final
+		{
+			const_iterator entry;
+			std::size_t first{ 0 };   // index of the directory's first file in files
+			std::size_t offset{ 0 };  // offset of the directory's file records, as written in its entry
+		};
 
-		template <class T>
-		[[nodiscard]] bool operator()(
-			const T& a_lhs,
-			const T& a_rhs) const noexcept
+		struct file_t final
 		{
-			return key_for(a_lhs) < key_for(a_rhs);
-		}
+			mapped_type::const_iterator entry;
+			std::size_t size{ 0 };    // size of the file's data on disk, excluding flags
+			std::size_t offset{ 0 };  // offset of the file's data
+			bool compressed{ false };  // whether the file's data is compressed on disk
+		};
 
-		[[nodiscard]] static auto key_for(
-			const intermediate_t::value_type& a_value) noexcept
-			-> std::uint64_t
+		// the directory which the file at a_file belongs to
+		[[nodiscard]] auto directory_of(std::size_t a_file) const noexcept
+			-> const directory_t&
 		{
-			return binary_io::endian::reverse(
-				a_value.first->first.hash().numeric());
+			// the last directory to start at or before the file (empty directories start at
+			// the same place as the directory after them)
+			return *std::prev(std::upper_bound(
+				directories.begin(),
+				directories.end(),
+				a_file,
+				[](std::size_t a_lhs, const directory_t& a_rhs) noexcept {
+					return a_lhs < a_rhs.first;
+				}));
 		}
 
-		[[nodiscard]] static auto key_for(
-			const mapped_type::value_type* a_value) noexcept
-			-> std::uint64_t
+		[[nodiscard]] auto files_of(const directory_t& a_dir) const noexcept
+			-> std::span<const file_t>
 		{
-			return binary_io::endian::reverse(
-				a_value->first.hash().numeric());
+			return std::span{ files }.subspan(a_dir.first, a_dir.entry->second.size());
 		}
+
+		detail::header_t header;
+		std::vector<directory_t> directories;
+		std::vector<file_t> files;
 	};
 
-	auto archive::make_header(version a_version) const noexcept
-		-> detail::header_t
+	bool archive::verify_offsets(version a_version) const
 	{
-		detail::header_t::info_t files;
-		detail::header_t::info_t dirs;
-
-		for (const auto& dir : *this) {
-			dirs.count += 1;
-
+		// only the offset of the last file written matters, and both it and the size of the
+		// tables can be found in one pass over the archive, without laying it out
+		const detail::header_t flags{ a_version, _flags, _types, {}, {} };
+		detail::header_t::info_t directoryInfo;
+		detail::header_t::info_t fileInfo;
+		std::size_t total = 0;
+		std::size_t last = 0;  // the size of the last file written
+		std::optional<std::pair<std::uint64_t, std::uint64_t>> lastKey;
+		for (const auto& [dkey, files] : *this) {
+			directoryInfo.count += 1;
 			if (this->directory_strings()) {
-				dirs.blobsz += static_cast<std::uint32_t>(
-					dir.first.name().length() +
+				directoryInfo.blobsz += static_cast<std::uint32_t>(
+					dkey.name().length() +
 					1u);  // null terminator
 			}
 
-			for (const auto& file : dir.second) {
-				files.count += 1;
-
+			for (const auto& [fkey, fdata] : files) {
+				const auto size = detail::record_size(flags, dkey.name(), fkey.name(), fdata);
+				total += size;
+				fileInfo.count += 1;
 				if (this->file_strings()) {
-					files.blobsz += static_cast<std::uint32_t>(
-						file.first.name().length() +
+					fileInfo.blobsz += static_cast<std::uint32_t>(
+						fkey.name().length() +
 						1u);  // null terminator
 				}
+
+				// files are otherwise written in the order they are iterated
+				if (this->xbox_archive()) {
+					const std::pair key{
+						detail::xbox_sort_key(dkey.hash()),
+						detail::xbox_sort_key(fkey.hash())
+					};
+					if (!lastKey || *lastKey < key) {
+						lastKey = key;
+						last = size;
+					}
+				} else {
+					last = size;
+				}
 			}
 		}
 
-		return {
-			a_version,
-			_flags,
-			_types,
-			dirs,
-			files
-		};
+		const detail::header_t header{ a_version, _flags, _types, directoryInfo, fileInfo };
+		const auto offset = detail::offsetof_file_data(header) + total - last;
+		return offset <= (std::numeric_limits<std::int32_t>::max)();
+	}
+
+	void archive::write(
+		write_sink a_sink,
+		version a_version) const
+	{
+		detail::ostream_t out{ a_sink.stream() };
+
+		const auto layout = this->make_layout(a_version);
+		this->write_tables(layout, out);
+		this->write_file_data(layout, out);
+		out.flush();
+	}
+
+	void archive::write(
+		write_sink a_sink,
+		version a_version,
+		const file::compression_params& a_params,
+		const executor& a_executor) const
+	{
+		// files are always compressed with the codec of the archive they're written into
+		auto params = a_params;
+		params.version_ = a_version;
+
+		auto& stream = a_sink.stream();
+		auto layout = this->make_layout(a_version);
+
+		// the tables don't change size once files are compressed, so space is reserved for them
+		// up front, and they are filled in once every file has been written
+		const auto start = stream.tell();
+		detail::ostream_t out{ stream };
+		detail::write_zeros(out, detail::offsetof_file_data(layout.header));
+
+		auto offset = detail::offsetof_file_data(layout.header);
+		std::vector<std::byte> prefix;
+		detail::pipeline<file>(
+			a_executor,
+			layout.files.size(),
+			[&](std::size_t a_idx) {
+				return layout.files[a_idx].entry->second.size();
+			},
+			[&](std::size_t a_idx) {
+				file result;
+				if (const auto& data = layout.files[a_idx].entry->second; !data.compressed()) {
+					result.set_data(data.as_bytes());
+					result.compress(params);
+				}
+				return result;
+			},
+			[&](std::size_t a_idx, const file& a_compressed) {
+				auto& file = layout.files[a_idx];
+				const auto& [key, data] = *file.entry;
+				const auto& source = data.compressed() ? data : a_compressed;
+
+				detail::make_data_prefix(
+					prefix,
+					layout.header,
+					layout.directory_of(a_idx).entry->first.name(),
+					key.name(),
+					source);
+				out.write_bytes(prefix);
+				out.write_bytes(source.as_bytes());
+
+				file.offset = offset;
+				file.size = prefix.size() + source.size();
+				file.compressed = true;
+				offset += file.size;
+
+				// compressed sizes aren't known up front, so verify_offsets can't catch these
+				if (file.offset > (std::numeric_limits<std::int32_t>::max)() ||
+					(file.size & (file::icompression | file::ichecked)) != 0) {
+					throw exception("file offsets exceed the limits of the archive format");
+				}
+			});
+		out.flush();
+
+		const auto end = stream.tell();
+		stream.seek_absolute(start);
+		this->write_tables(layout, out);
+		out.flush();
+		stream.seek_absolute(end);
 	}
 
 	auto archive::read_file_entries(
@@ -1010,10 +1237,13 @@ namespace bsa::tes4
 		detail::istream_t& a_in,
 		const detail::header_t& a_header,
 		std::size_t a_count,
-		std::size_t& a_namesOffset)
+		std::span<const std::string_view>& a_names,
+		bool a_lazy)
 		-> std::optional<std::string_view>
 	{
 		std::optional<std::string_view> dirname;
+		std::vector<std::pair<directory::key_type, directory::mapped_type>> files;
+		files.reserve((std::min)(a_count, a_in->rdbuf().size() / detail::constants::file_entry_size));
 
 		for (std::size_t i = 0; i < a_count; ++i) {
 			hashing::hash hash;
@@ -1026,18 +1256,25 @@ namespace bsa::tes4
 
 			const auto tableName = [&]() -> std::optional<std::string_view> {
 				if (a_header.file_strings()) {
-					const detail::restore_point r{ a_in };
-					a_in->seek_absolute(a_namesOffset);
-					const auto name = detail::read_zstring(a_in);
-					a_namesOffset = a_in->tell();
+					if (a_names.empty()) {
+						throw binary_io::buffer_exhausted();
+					}
+					const auto name = a_names.front();
+					a_names = a_names.subspan(1);
 					return name;
 				} else {
 					return std::nullopt;
 				}
 			}();
 
+			const auto record = static_cast<std::size_t>(a_in->tell());
+			const bool needsEmbeddedName =
+				!a_lazy ||
+				!a_header.file_strings() ||
+				(!dirname && !a_header.directory_strings());
+
 			const auto embeddedName = [&]() -> std::optional<std::string_view> {
-				if (a_header.embedded_file_names()) {
+				if (a_header.embedded_file_names() && needsEmbeddedName) {
 					auto name = detail::read_bstring(a_in);
 					size -= static_cast<std::uint32_t>(name.length() + 1u);
 					const auto pos = name.find_last_of("\\/"sv);
@@ -1060,15 +1297,19 @@ namespace bsa::tes4
 				embeddedName ? *embeddedName :
 							   ""sv;
 
-			[[maybe_unused]] const auto [it, success] =
-				a_dir.insert(
-					directory::key_type{ hash, fname, a_in },
-					directory::mapped_type{});
-			assert(success);
+			file f;
+			if (a_lazy) {
+				this->read_file_record(f, a_in, a_header, size, record);
+			} else {
+				this->read_file_data(f, a_in, a_header, size);
+			}
 
-			this->read_file_data(it->second, a_in, a_header, size);
+			files.emplace_back(
+				directory::key_type{ hash, fname, a_in },
+				std::move(f));
 		}
 
+		a_dir.assign(std::move(files));
 		return dirname;
 	}
 
@@ -1092,11 +1333,42 @@ namespace bsa::tes4
 		a_file.set_data(a_in->read_bytes(a_size), a_in, decompsz);
 	}
 
-	void archive::read_directory(
+	void archive::read_file_record(
+		file& a_file,
+		detail::istream_t& a_in,
+		const detail::header_t& a_header,
+		std::size_t a_size,
+		std::size_t a_record)
+	{
+		// the size on disk spans the whole record, including any name we may have consumed
+		const auto pos = static_cast<std::size_t>(a_in->tell());
+		const auto record = static_cast<std::uint32_t>(a_size + (pos - a_record));
+		a_in->seek_absolute(a_record);
+
+		const bool compressed =
+			record & file::icompression ?
+				!a_header.compressed() :
+				a_header.compressed();
+		const bool named = a_header.embedded_file_names();
+
+		// the prefixes are only parsed on access, which is also when an embedded name is checked
+		// to fit within its record, but the record must at least be able to hold their lengths
+		const std::size_t size = record & ~(file::ichecked | file::icompression);
+		const std::size_t prefix = (compressed ? 4u : 0u) + (named ? 1u : 0u);
+		if (prefix > size) {
+			throw binary_io::buffer_exhausted();
+		}
+
+		a_file.set_data_deferred(a_in->read_bytes(size), a_in, named, compressed);
+	}
+
+	auto archive::read_directory(
 		detail::istream_t& a_in,
 		const detail::header_t& a_header,
 		std::size_t& a_filesOffset,
-		std::size_t& a_namesOffset)
+		std::span<const std::string_view>& a_names,
+		bool a_lazy)
+		-> std::pair<key_type, mapped_type>
 	{
 		hashing::hash hash;
 		hash.read(a_in, a_header.endian());
@@ -1126,7 +1398,7 @@ namespace bsa::tes4
 				std::nullopt;
 
 		directory d;
-		const auto embeddedName = this->read_file_entries(d, a_in, a_header, count, a_namesOffset);
+		const auto embeddedName = this->read_file_entries(d, a_in, a_header, count, a_names, a_lazy);
 
 		// prefer directory string table name, see #7
 		const auto dname =
@@ -1134,54 +1406,167 @@ namespace bsa::tes4
 			embeddedName ? *embeddedName :
 						   ""sv;
 
-		[[maybe_unused]] const auto [it, success] =
-			this->insert(
-				key_type{ hash, dname, a_in },
-				std::move(d));
-		assert(success);
-
 		a_filesOffset = a_in->tell();
+		return { key_type{ hash, dname, a_in }, std::move(d) };
 	}
 
-	auto archive::sort_for_write(bool a_xbox) const noexcept
-		-> intermediate_t
+	void archive::write(
+		const std::filesystem::path& a_path,
+		version a_version,
+		const executor& a_executor) const
+	{
+		const auto layout = this->make_layout(a_version);
+		const auto size = layout.files.empty() ?
+		                      detail::offsetof_file_data(layout.header) :
+		                      layout.files.back().offset + layout.files.back().size;
+		const detail::positional_ostream out{ a_path, size };
+
+		detail::parallel_for(a_executor, layout.files.size(), [&](std::size_t a_idx) {
+			const auto& file = layout.files[a_idx];
+			const auto& [key, data] = *file.entry;
+			const auto& dir = layout.directory_of(a_idx);
+
+			thread_local std::vector<std::byte> prefix;
+			detail::make_data_prefix(prefix, layout.header, dir.entry->first.name(), key.name(), data);
+			out.write_bytes(file.offset, prefix);
+			out.write_bytes(file.offset + prefix.size(), data.as_bytes());
+		});
+
+		binary_io::any_ostream buffer{ std::in_place_type<binary_io::memory_ostream> };
+		detail::ostream_t tables{ buffer };
+		this->write_tables(layout, tables);
+		tables.flush();
+
+		const auto& bytes = buffer.get<binary_io::memory_ostream>().rdbuf();
+		assert(bytes.size() == detail::offsetof_file_data(layout.header));
+		out.write_bytes(0, bytes);
+	}
+
+	auto archive::make_layout(version a_version) const
+		-> layout_t
 	{
-		intermediate_t result;
-		result.reserve(this->size());
-		for (const auto& dir : *this) {
-			auto& elem = result.emplace_back();
-			elem.first = &dir;
-			elem.second.reserve(dir.second.size());
-			for (const auto& file : dir.second) {
-				elem.second.push_back(&file);
+		layout_t layout;
+		layout.directories.reserve(this->size());
+		layout.files.reserve([&]() noexcept {
+			std::size_t count = 0;
+			for (const auto& dir : *this) {
+				count += dir.second.size();
+			}
+			return count;
+		}());
+
+		// the counts are filled in once they are known, but the flags are needed up front
+		layout.header = { a_version, _flags, _types, {}, {} };
+
+		detail::header_t::info_t directoryInfo;
+		detail::header_t::info_t fileInfo;
+		for (auto dir = this->begin(); dir != this->end(); ++dir) {
+			const auto& [dkey, files] = *dir;
+			layout.directories.push_back({ dir, layout.files.size() });
+			directoryInfo.count += 1;
+			if (this->directory_strings()) {
+				directoryInfo.blobsz += static_cast<std::uint32_t>(
+					dkey.name().length() +
+					1u);  // null terminator
 			}
 
-			if (a_xbox) {
-				std::sort(elem.second.begin(), elem.second.end(), xbox_sort_t{});
+			for (auto file = files.begin(); file != files.end(); ++file) {
+				const auto& [fkey, fdata] = *file;
+				const auto size = detail::record_size(layout.header, dkey.name(), fkey.name(), fdata);
+				layout.files.push_back({ file, size, 0, fdata.compressed() });
+				fileInfo.count += 1;
+				if (this->file_strings()) {
+					fileInfo.blobsz += static_cast<std::uint32_t>(
+						fkey.name().length() +
+						1u);  // null terminator
+				}
 			}
 		}
 
-		if (a_xbox) {
-			std::sort(result.begin(), result.end(), xbox_sort_t{});
+		if (this->xbox_archive()) {
+			// sort the directories by their own key
+			std::vector<std::pair<std::uint64_t, std::size_t>> dirs;
+			dirs.reserve(layout.directories.size());
+			for (std::size_t i = 0; i < layout.directories.size(); ++i) {
+				dirs.emplace_back(detail::xbox_sort_key(layout.directories[i].entry->first.hash()), i);
+			}
+			detail::radix_sort(dirs);
+
+			// then sort every file at once by its key, and stably scatter them into the
+			// slots of their (now sorted) directories
+			std::vector<std::size_t> owners(layout.files.size());
+			std::vector<std::size_t> slots(layout.directories.size());
+			std::vector<layout_t::directory_t> sorted;
+			sorted.reserve(layout.directories.size());
+			for (const auto& [key, idx] : dirs) {
+				const auto& dir = layout.directories[idx];
+				std::fill_n(owners.begin() + dir.first, dir.entry->second.size(), idx);
+				slots[idx] = sorted.empty() ?
+				                 0 :
+				                 sorted.back().first + sorted.back().entry->second.size();
+				sorted.push_back({ dir.entry, slots[idx] });
+			}
+
+			std::vector<std::pair<std::uint64_t, std::size_t>> files;
+			files.reserve(layout.files.size());
+			for (std::size_t i = 0; i < layout.files.size(); ++i) {
+				files.emplace_back(detail::xbox_sort_key(layout.files[i].entry->first.hash()), i);
+			}
+			detail::radix_sort(files);
+
+			std::vector<layout_t::file_t> scattered(layout.files.size());
+			for (const auto& [key, idx] : files) {
+				scattered[slots[owners[idx]]++] = layout.files[idx];
+			}
+
+			layout.directories = std::move(sorted);
+			layout.files = std::move(scattered);
 		}
 
-		return result;
+		layout.header = {
+			a_version,
+			_flags,
+			_types,
+			directoryInfo,
+			fileInfo
+		};
+		const auto& header = layout.header;
+
+		// file records follow the directory entries, but the game expects their offsets to
+		// include the length of the file names, which are written after them
+		auto records = detail::offsetof_file_entries(header) + header.file_names_length();
+		for (auto& dir : layout.directories) {
+			dir.offset = records;
+			if (header.directory_strings()) {
+				records +=
+					dir.entry->first.name().length() +
+					1u +  // prefixed byte length
+					1u;   // null terminator
+			}
+			records += detail::constants::file_entry_size * dir.entry->second.size();
+		}
+
+		auto data = detail::offsetof_file_data(header);
+		for (auto& file : layout.files) {
+			file.offset = data;
+			data += file.size;
+		}
+
+		return layout;
 	}
 
 	void archive::write_directory_entries(
-		const intermediate_t& a_intermediate,
-		detail::ostream_t& a_out,
-		const detail::header_t& a_header) const noexcept
+		const layout_t& a_layout,
+		detail::ostream_t& a_out) const noexcept
 	{
-		auto offset = static_cast<std::uint32_t>(detail::offsetof_file_entries(a_header));
-		offset += static_cast<std::uint32_t>(a_header.file_names_length());
-
-		for (const auto& elem : a_intermediate) {
-			const auto& [key, dir] = *elem.first;
-			key.hash().write(a_out, a_header.endian());
+		const auto& header = a_layout.header;
+		for (const auto& elem : a_layout.directories) {
+			const auto& [key, dir] = *elem.entry;
+			key.hash().write(a_out, header.endian());
 			a_out.write(static_cast<std::uint32_t>(dir.size()));
 
-			switch (a_header.archive_version()) {
+			const auto offset = static_cast<std::uint32_t>(elem.offset);
+			switch (header.archive_version()) {
 			case 103:
 			case 104:
 				a_out.write(offset);
@@ -1195,104 +1580,69 @@ namespace bsa::tes4
 			default:
 				detail::declare_unreachable();
 			}
-
-			if (a_header.directory_strings()) {
-				offset += static_cast<std::uint32_t>(
-					key.name().length() +
-					1u +  // prefixed byte length
-					1u);  // null terminator
-			}
-
-			offset += static_cast<std::uint32_t>(
-				detail::constants::file_entry_size *
-				dir.size());
 		}
 	}
 
 	void archive::write_file_data(
-		const intermediate_t& a_intermediate,
-		detail::ostream_t& a_out,
-		const detail::header_t& a_header) const noexcept
+		const layout_t& a_layout,
+		detail::ostream_t& a_out) const
 	{
-		for (const auto& elem : a_intermediate) {
-			const auto& dir = *elem.first;
-			const auto dirname = dir.first.name();
-			std::span dirbytes{
-				reinterpret_cast<const std::byte*>(dirname.data()),
-				dirname.size()
-			};
-
-			for (const auto file : elem.second) {
-				if (a_header.embedded_file_names()) {
-					const auto fname = file->first.name();
-					const auto len = dirbytes.size() +
-					                 1u +  // directory separator
-					                 fname.size();
-					a_out.write(static_cast<std::uint8_t>(len));
-					a_out.write_bytes(dirbytes);
-					a_out.write(std::byte{ '\\' });
-					a_out.write_bytes({ //
-						reinterpret_cast<const std::byte*>(fname.data()),
-						fname.size() });
-				}
-
-				if (file->second.compressed()) {
-					a_out.write(static_cast<std::uint32_t>(file->second.decompressed_size()));
-				}
-
-				a_out.write_bytes(file->second.as_bytes());
+		std::vector<std::byte> prefix;
+		for (const auto& elem : a_layout.directories) {
+			const auto dirname = elem.entry->first.name();
+			for (const auto& file : a_layout.files_of(elem)) {
+				const auto& [key, data] = *file.entry;
+				detail::make_data_prefix(prefix, a_layout.header, dirname, key.name(), data);
+				a_out.write_bytes(prefix);
+				a_out.write_bytes(data.as_bytes());
 			}
 		}
 	}
 
 	void archive::write_file_entries(
-		const intermediate_t& a_intermediate,
-		detail::ostream_t& a_out,
-		const detail::header_t& a_header) const noexcept
+		const layout_t& a_layout,
+		detail::ostream_t& a_out) const noexcept
 	{
-		auto offset = static_cast<std::uint32_t>(detail::offsetof_file_data(a_header));
-		for (const auto& elem : a_intermediate) {
-			const auto& dir = *elem.first;
-			if (a_header.directory_strings()) {
+		const auto& header = a_layout.header;
+		for (const auto& elem : a_layout.directories) {
+			const auto& dir = *elem.entry;
+			if (header.directory_strings()) {
 				detail::write_bzstring(a_out, dir.first.name());
 			}
 
-			for (const auto file : elem.second) {
-				file->first.hash().write(a_out, a_header.endian());
-				auto fsize = file->second.size();
-
-				if (!!a_header.compressed() != !!file->second.compressed()) {
-					fsize |= file::icompression;
-				}
-
-				if (a_header.embedded_file_names()) {
-					fsize += static_cast<std::uint32_t>(
-						1u +  // prefixed byte length
-						dir.first.name().length() +
-						1u +  // directory separator
-						file->first.name().length());
-				}
+			for (const auto& file : a_layout.files_of(elem)) {
+				file.entry->first.hash().write(a_out, header.endian());
 
-				if (file->second.compressed()) {
-					fsize += 4u;
+				auto size = file.size;
+				if (header.compressed() != file.compressed) {
+					size |= file::icompression;
 				}
 
 				a_out.write(
-					static_cast<std::uint32_t>(fsize),
-					offset);
-				offset += static_cast<std::uint32_t>(fsize & ~file::icompression);
+					static_cast<std::uint32_t>(size),
+					static_cast<std::uint32_t>(file.offset));
 			}
 		}
 	}
 
 	void archive::write_file_names(
-		const intermediate_t& a_intermediate,
+		const layout_t& a_layout,
 		detail::ostream_t& a_out) const noexcept
 	{
-		for (const auto& elem : a_intermediate) {
-			for (const auto file : elem.second) {
-				detail::write_zstring(a_out, file->first.name());
-			}
+		for (const auto& file : a_layout.files) {
+			detail::write_zstring(a_out, file.entry->first.name());
+		}
+	}
+
+	void archive::write_tables(
+		const layout_t& a_layout,
+		detail::ostream_t& a_out) const noexcept
+	{
+		a_out << a_layout.header;
+		this->write_directory_entries(a_layout, a_out);
+		this->write_file_entries(a_layout, a_out);
+		if (a_layout.header.file_strings()) {
+			this->write_file_names(a_layout, a_out);
 		}
 	}
 }
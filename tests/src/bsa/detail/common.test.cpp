@@ -1,13 +1,140 @@
 #include "utility.hpp"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
 #include <filesystem>
+#include <mutex>
+#include <new>
+#include <random>
+#include <set>
+#include <string>
+#include <string_view>
 #include <system_error>
+#include <thread>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "catch2.hpp"
 
 #include "bsa/detail/common.hpp"
+#include "bsa/fo4.hpp"
+#include "bsa/tes3.hpp"
+#include "bsa/tes4.hpp"
+
+namespace
+{
+	std::atomic_size_t allocations{ 0 };
+}
+
+// count every allocation made by the test binary, so that we can check which code paths allocate
+void* operator new(std::size_t a_size)
+{
+	++allocations;
+	if (const auto ptr = std::malloc(a_size != 0 ? a_size : 1); ptr) {
+		return ptr;
+	} else {
+		throw std::bad_alloc();
+	}
+}
+
+// gcc flags the free as mismatched, even though it pairs with the malloc above
+#if defined(__GNUC__) && !defined(__clang__)
+#	pragma GCC diagnostic push
+#	pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void* a_ptr) noexcept { std::free(a_ptr); }
+void operator delete(void* a_ptr, std::size_t) noexcept { std::free(a_ptr); }
+
+#if defined(__GNUC__) && !defined(__clang__)
+#	pragma GCC diagnostic pop
+#endif
+
+namespace
+{
+	[[nodiscard]] auto make_hashes(std::size_t a_count)
+		-> std::vector<bsa::tes3::hashing::hash>
+	{
+		std::vector<bsa::tes3::hashing::hash> result;
+		result.reserve(a_count);
+		for (std::uint32_t i = 0; i < a_count; ++i) {
+			result.push_back({ i * 0x9E3779B9u, i });
+		}
+		std::sort(result.begin(), result.end());
+		return result;
+	}
+
+	// the original, character at a time implementation
+	void normalize_path_reference(std::string& a_path)
+	{
+		for (auto& c : a_path) {
+			if (c == '/') {
+				c = '\\';
+			} else if ('A' <= c && c <= 'Z') {
+				c += 'a' - 'A';
+			}
+		}
+
+		while (!a_path.empty() && a_path.back() == '\\') {
+			a_path.pop_back();
+		}
+
+		while (!a_path.empty() && a_path.front() == '\\') {
+			a_path.erase(a_path.begin());
+		}
+
+		if (a_path.empty() || a_path.size() >= 260) {
+			a_path = '.';
+		}
+	}
+
+	[[nodiscard]] auto make_paths(std::size_t a_count)
+		-> std::vector<std::string>
+	{
+		constexpr std::array roots{
+			"Meshes/"sv,
+			"textures\\"sv,
+			"Sound/FX/"sv,
+			"/Interface/"sv,
+		};
+		constexpr std::array parts{
+			"Architecture"sv,
+			"Whiterun"sv,
+			"WRBuildings"sv,
+			"Clutter"sv,
+			"DwemerRuins"sv,
+			"Landscape"sv,
+			"Trees"sv,
+			"Actors"sv,
+		};
+		constexpr std::array extensions{
+			".nif"sv,
+			".DDS"sv,
+			".wav"sv,
+			".swf"sv,
+		};
+
+		std::mt19937 rng;
+		std::vector<std::string> result;
+		result.reserve(a_count);
+		for (std::size_t i = 0; i < a_count; ++i) {
+			auto& path = result.emplace_back(roots[rng() % roots.size()]);
+			for (auto depth = rng() % 4 + 1; depth > 0; --depth) {
+				path += parts[rng() % parts.size()];
+				path += '/';
+			}
+			path += parts[rng() % parts.size()];
+			path += std::to_string(i);
+			path += extensions[rng() % extensions.size()];
+		}
+		return result;
+	}
+}
 
 TEST_CASE("bsa::functional", "[src][common]")
 {
@@ -42,4 +169,552 @@ TEST_CASE("bsa::functional", "[src][common]")
 		REQUIRE(bsa::make_four_cc("ABCD"sv) == 0x44434241);
 		REQUIRE(bsa::make_four_cc("ABCDE"sv) == 0x44434241);
 	}
+
+	SECTION("normalize_path matches the character at a time implementation")
+	{
+		std::mt19937 rng;
+		constexpr std::array alphabet{ 'a', 'Z', 'A', 'z', '@', '[', '`', '{', '/', '\\', '.', '\xC0', '\xDA', '\xFF' };
+		for (std::size_t i = 0; i < 10'000; ++i) {
+			std::string path(rng() % 300, '\0');
+			for (auto& c : path) {
+				c = alphabet[rng() % alphabet.size()];
+			}
+			if (rng() % 2 == 0) {
+				path.insert(0, rng() % 20, '/');
+				path.append(rng() % 20, '\\');
+			}
+
+			auto expected = path;
+			normalize_path_reference(expected);
+			bsa::detail::normalize_path(path);
+			REQUIRE(path == expected);
+		}
+	}
+
+	SECTION("zstrings are scanned up to their terminator")
+	{
+		constexpr std::string_view table{ "foo\0\0bar.nif\0baz"sv };
+		const auto bytes = std::as_bytes(std::span{ table.data(), table.size() });
+
+		bsa::detail::istream_t in{ bytes, bsa::copy_type::shallow };
+		REQUIRE(bsa::detail::read_zstring(in) == "foo"sv);
+		REQUIRE(bsa::detail::read_zstring(in) == ""sv);
+		REQUIRE(bsa::detail::read_zstring(in) == "bar.nif"sv);
+		REQUIRE(in->tell() == 13);
+		REQUIRE_THROWS_AS(bsa::detail::read_zstring(in), binary_io::buffer_exhausted);
+
+		in->seek_absolute(0);
+		REQUIRE(bsa::detail::read_zstrings(in, 2) == std::vector{ "foo"sv, ""sv });
+		REQUIRE(in->tell() == 5);
+		REQUIRE(bsa::detail::read_zstrings(in, 10) == std::vector{ "bar.nif"sv });
+		REQUIRE(in->tell() == 13);
+	}
+
+	SECTION("hashing string views does not allocate")
+	{
+		constexpr auto path = "Textures\\Terrain\\Commonwealth\\Commonwealth.4.-8.12_msn.DDS"sv;
+		const auto before = allocations.load();
+		[[maybe_unused]] const auto tes3 = bsa::tes3::hashing::hash_file(path);
+		[[maybe_unused]] const auto tes4d = bsa::tes4::hashing::hash_directory(path);
+		[[maybe_unused]] const auto tes4f = bsa::tes4::hashing::hash_file(path);
+		[[maybe_unused]] const auto fo4 = bsa::fo4::hashing::hash_file(path);
+		REQUIRE(allocations.load() == before);
+
+		const auto rejected = std::string(300, 'a');
+		const auto view = std::string_view{ rejected };
+		const auto after = allocations.load();
+		REQUIRE(bsa::tes4::hashing::hash_directory(view) == bsa::tes4::hashing::hash_directory("."sv));
+		REQUIRE(allocations.load() == after);
+	}
+
+	SECTION("hashing string views matches hashing strings in place")
+	{
+		for (const auto& path : make_paths(1'000)) {
+			auto copy = path;
+			REQUIRE(bsa::tes3::hashing::hash_file(std::string_view{ path }) == bsa::tes3::hashing::hash_file_in_place(copy));
+			copy = path;
+			REQUIRE(bsa::tes4::hashing::hash_directory(std::string_view{ path }) == bsa::tes4::hashing::hash_directory_in_place(copy));
+			copy = path;
+			REQUIRE(bsa::tes4::hashing::hash_file(std::string_view{ path }) == bsa::tes4::hashing::hash_file_in_place(copy));
+			copy = path;
+			REQUIRE(bsa::fo4::hashing::hash_file(std::string_view{ path }) == bsa::fo4::hashing::hash_file_in_place(copy));
+		}
+	}
+
+	SECTION("batch hashing matches hashing one path at a time")
+	{
+		const auto strings = make_paths(5'000);
+		const std::vector<std::string_view> paths(strings.begin(), strings.end());
+
+		const auto check = [&]<class Hash>(auto a_batch, auto a_single) {
+			for (const auto& executor : { bsa::executor{}, bsa::make_thread_executor(4) }) {
+				std::vector<Hash> hashes(paths.size());
+				a_batch(std::span{ paths }, std::span{ hashes }, executor);
+				for (std::size_t i = 0; i < paths.size(); ++i) {
+					REQUIRE(hashes[i] == a_single(paths[i]));
+				}
+			}
+		};
+
+		check.operator()<bsa::tes3::hashing::hash>(
+			[](auto... a_args) { bsa::tes3::hashing::hash_files(a_args...); },
+			[](std::string_view a_path) { return bsa::tes3::hashing::hash_file(a_path); });
+		check.operator()<bsa::tes4::hashing::hash>(
+			[](auto... a_args) { bsa::tes4::hashing::hash_directories(a_args...); },
+			[](std::string_view a_path) { return bsa::tes4::hashing::hash_directory(a_path); });
+		check.operator()<bsa::tes4::hashing::hash>(
+			[](auto... a_args) { bsa::tes4::hashing::hash_files(a_args...); },
+			[](std::string_view a_path) { return bsa::tes4::hashing::hash_file(a_path); });
+		check.operator()<bsa::fo4::hashing::hash>(
+			[](auto... a_args) { bsa::fo4::hashing::hash_files(a_args...); },
+			[](std::string_view a_path) { return bsa::fo4::hashing::hash_file(a_path); });
+	}
+
+	SECTION("executors run every task exactly once")
+	{
+		for (const auto threads : { std::size_t{ 0 }, std::size_t{ 1 }, std::size_t{ 4 } }) {
+			const auto executor = bsa::make_thread_executor(threads);
+			for (const auto count : { std::size_t{ 0 }, std::size_t{ 1 }, std::size_t{ 1000 } }) {
+				std::vector<std::atomic_int> runs(count);
+				executor(count, [&](std::size_t a_idx) { ++runs[a_idx]; });
+				REQUIRE(std::all_of(runs.begin(), runs.end(), [](const auto& a_runs) { return a_runs == 1; }));
+			}
+		}
+	}
+
+	SECTION("thread executors reuse the same threads across batches")
+	{
+		const auto executor = bsa::make_thread_executor(4);
+		std::mutex lock;
+		std::set<std::thread::id> threads;
+		for (std::size_t i = 0; i < 100; ++i) {
+			executor(64, [&](std::size_t) {
+				const std::lock_guard l{ lock };
+				threads.insert(std::this_thread::get_id());
+			});
+		}
+		REQUIRE(threads.size() <= 4);
+	}
+
+	SECTION("the default executor is shared by every call which relies on it")
+	{
+		const auto& executor = bsa::default_executor();
+		REQUIRE(&executor == &bsa::default_executor());
+
+		std::mutex lock;
+		std::set<std::thread::id> threads;
+		for (std::size_t i = 0; i < 100; ++i) {
+			executor(64, [&](std::size_t) {
+				const std::lock_guard l{ lock };
+				threads.insert(std::this_thread::get_id());
+			});
+		}
+		REQUIRE(threads.size() <= (std::max)(std::size_t{ std::thread::hardware_concurrency() }, std::size_t{ 1 }));
+	}
+
+		SECTION("exceptions thrown by tasks are rethrown once every task has finished")
+	{
+		for (const auto& executor : { bsa::executor{}, bsa::make_thread_executor(4) }) {
+			std::atomic_size_t finished{ 0 };
+			REQUIRE_THROWS_AS(
+				bsa::detail::parallel_for(executor, 100, [&](std::size_t a_idx) {
+					if (a_idx % 10 == 0) {
+						throw bsa::exception("task failed");
+					}
+					++finished;
+				}),
+				bsa::exception);
+			REQUIRE(finished == 90);
+		}
+	}
+
+	SECTION("pipelines consume every item in order, across many windows")
+	{
+		// costs which trip the budget, including items which blow through it on their own
+		const auto cost = [](std::size_t a_idx) noexcept {
+			return a_idx % 37 == 0 ? std::size_t{ 100 } : a_idx % 7;
+		};
+		constexpr bsa::detail::pipeline_window window{ .budget = 16, .max_items = 8 };
+
+		for (const auto& executor : { bsa::executor{}, bsa::make_thread_executor(4) }) {
+			for (const auto count : { std::size_t{ 0 }, std::size_t{ 1 }, std::size_t{ 1000 } }) {
+				std::vector<std::pair<std::size_t, std::size_t>> consumed;
+				bsa::detail::pipeline<std::size_t>(
+					executor,
+					count,
+					cost,
+					[](std::size_t a_idx) { return a_idx * 3; },
+					[&](std::size_t a_idx, std::size_t a_value) { consumed.emplace_back(a_idx, a_value); },
+					window);
+
+				REQUIRE(consumed.size() == count);
+				for (std::size_t i = 0; i < consumed.size(); ++i) {
+					REQUIRE(consumed[i].first == i);
+					REQUIRE(consumed[i].second == i * 3);
+				}
+			}
+		}
+	}
+
+	SECTION("pipelines start consuming a window before producing the next one")
+	{
+		// the empty executor starts tasks in ascending order, as every executor should
+		std::vector<std::pair<char, std::size_t>> events;
+		bsa::detail::pipeline<std::size_t>(
+			bsa::executor{},
+			10,
+			[](std::size_t) noexcept { return std::size_t{ 1 }; },
+			[&](std::size_t a_idx) {
+				events.emplace_back('p', a_idx);
+				return a_idx;
+			},
+			[&](std::size_t a_idx, std::size_t) { events.emplace_back('c', a_idx); },
+			{ .max_items = 4 });
+
+		const std::vector<std::pair<char, std::size_t>> expected{
+			{ 'p', 0 }, { 'p', 1 }, { 'p', 2 }, { 'p', 3 },
+			{ 'c', 0 }, { 'c', 1 }, { 'c', 2 }, { 'c', 3 },
+			{ 'p', 4 }, { 'p', 5 }, { 'p', 6 }, { 'p', 7 },
+			{ 'c', 4 }, { 'c', 5 }, { 'c', 6 }, { 'c', 7 },
+			{ 'p', 8 }, { 'p', 9 },
+			{ 'c', 8 }, { 'c', 9 },
+		};
+		REQUIRE(events == expected);
+	}
+}
+
+TEMPLATE_TEST_CASE(
+	"bsa::components::hashmap",
+	"[src][common]",
+	bsa::components::tree_storage,
+	bsa::components::flat_storage)
+{
+	using hashmap_t = bsa::components::hashmap<bsa::tes3::file, false, TestType>;
+	using key_t = typename hashmap_t::key_type;
+
+	auto hashes = make_hashes(0x1000);
+	std::shuffle(hashes.begin(), hashes.end(), std::mt19937{ 0x1000 });
+
+	hashmap_t map;
+	for (const auto& hash : hashes) {
+		const auto [it, success] = map.insert(key_t{ hash }, {});
+		REQUIRE(success);
+		REQUIRE(it->first.hash() == hash);
+	}
+	REQUIRE(map.size() == hashes.size());
+
+	SECTION("keys can't be modified through iterators")
+	{
+		using value_t = std::pair<const key_t, bsa::tes3::file>;
+		STATIC_REQUIRE(std::is_same_v<typename hashmap_t::value_type, value_t>);
+
+		// flat storage hands out a pair of references, rather than a reference to a pair
+		using reference_t = decltype(*map.begin());
+		using const_reference_t = decltype(*std::as_const(map).begin());
+		STATIC_REQUIRE(std::is_same_v<decltype((std::declval<reference_t>().first)), const key_t&>);
+		STATIC_REQUIRE(std::is_same_v<decltype((std::declval<reference_t>().second)), bsa::tes3::file&>);
+		STATIC_REQUIRE(std::is_same_v<decltype((std::declval<const_reference_t>().first)), const key_t&>);
+		STATIC_REQUIRE(std::is_same_v<decltype((std::declval<const_reference_t>().second)), const bsa::tes3::file&>);
+		STATIC_REQUIRE(!std::is_assignable_v<decltype((map.begin()->first)), key_t>);
+
+		auto& file = map.begin()->second;
+		file.set_data(std::vector<std::byte>(1));
+		REQUIRE(map.begin()->second.size() == 1);
+	}
+
+		SECTION("elements are iterated in ascending order of their hash")
+	{
+		REQUIRE(std::is_sorted(
+			map.begin(),
+			map.end(),
+			[](const auto& a_lhs, const auto& a_rhs) {
+				return a_lhs.first < a_rhs.first;
+			}));
+	}
+
+	SECTION("elements can be found after insertion")
+	{
+		for (const auto& hash : hashes) {
+			const auto it = map.find(hash);
+			REQUIRE(it != map.end());
+			REQUIRE(it->first.hash() == hash);
+			REQUIRE(map[hash]);
+		}
+		REQUIRE(map.find(bsa::tes3::hashing::hash{ 1, 0 }) == map.end());
+	}
+
+	SECTION("duplicate keys are rejected")
+	{
+		for (const auto& hash : hashes) {
+			const auto [it, success] = map.insert(key_t{ hash }, {});
+			REQUIRE(!success);
+			REQUIRE(it->first.hash() == hash);
+		}
+		REQUIRE(map.size() == hashes.size());
+	}
+
+	SECTION("elements can be erased")
+	{
+		for (std::size_t i = 0; i < hashes.size(); i += 2) {
+			REQUIRE(map.erase(hashes[i]));
+			REQUIRE(!map.erase(hashes[i]));
+		}
+		REQUIRE(map.size() == hashes.size() / 2);
+		for (std::size_t i = 0; i < hashes.size(); ++i) {
+			REQUIRE((map.find(hashes[i]) != map.end()) == (i % 2 != 0));
+		}
+	}
+
+	SECTION("elements can be looked up by string without allocating")
+	{
+		constexpr auto path = "Meshes/Clutter/Bucket.NIF"sv;
+		const auto [it, success] = map.insert(key_t{ path }, {});
+		REQUIRE(success);
+		REQUIRE(it->first.name() == "meshes\\clutter\\bucket.nif"sv);
+
+		const std::string owned{ path };
+		const auto before = allocations.load();
+		REQUIRE(map.find(path) == it);
+		REQUIRE(map.find(owned) == it);
+		REQUIRE(map.find("meshes\\clutter\\bucket.nif") == it);
+		REQUIRE(map.find(it->first.hash()) == it);
+		REQUIRE(map[path]);
+		REQUIRE(std::as_const(map)[owned]);
+		REQUIRE(map.find("meshes/clutter/pail.nif"sv) == map.end());
+		REQUIRE(allocations.load() == before);
+
+		REQUIRE(map.erase(owned));
+		REQUIRE(!map.erase(path));
+	}
+
+	SECTION("assigning elements sorts them, and keeps the first of any duplicates")
+	{
+		std::vector<std::pair<key_t, bsa::tes3::file>> values;
+		for (const auto& hash : hashes) {
+			values.emplace_back(key_t{ hash }, bsa::tes3::file{});
+		}
+		values.emplace_back(key_t{ hashes.front() }, bsa::tes3::file{});
+		values.back().second.set_data(std::vector<std::byte>(1));
+
+		hashmap_t assigned;
+		assigned.assign(values);
+		REQUIRE(assigned.size() == hashes.size());
+		REQUIRE(assigned[hashes.front()]->empty());
+		REQUIRE(std::equal(
+			map.begin(),
+			map.end(),
+			assigned.begin(),
+			assigned.end(),
+			[](const auto& a_lhs, const auto& a_rhs) {
+				return a_lhs.first == a_rhs.first;
+			}));
+
+		std::sort(values.begin(), values.end(), [](const auto& a_lhs, const auto& a_rhs) {
+			return a_lhs.first < a_rhs.first;
+		});
+		assigned.assign(std::move(values));
+		REQUIRE(assigned.size() == hashes.size());
+	}
+
+	SECTION("try_emplace only inserts missing keys")
+	{
+		const auto [first, inserted] = map.try_emplace("textures/clutter/bucket.dds"sv);
+		REQUIRE(inserted);
+		REQUIRE(map.size() == hashes.size() + 1);
+
+		const auto [second, reinserted] = map.try_emplace("Textures\\Clutter\\Bucket.dds"sv);
+		REQUIRE(!reinserted);
+		REQUIRE(second->first == first->first);
+		REQUIRE(map.size() == hashes.size() + 1);
+	}
+}
+
+TEMPLATE_TEST_CASE(
+	"bsa::components::hashmap benchmarks",
+	"[.][benchmark][common]",
+	bsa::components::tree_storage,
+	bsa::components::flat_storage)
+{
+	using hashmap_t = bsa::components::hashmap<bsa::tes3::file, false, TestType>;
+	using key_t = typename hashmap_t::key_type;
+
+	const auto hashes = make_hashes(200'000);
+	const auto build = [&]() {
+		hashmap_t map;
+		for (const auto& hash : hashes) {
+			map.insert(key_t{ hash }, {});
+		}
+		return map;
+	};
+
+	BENCHMARK("read")
+	{
+		return build();
+	};
+
+	auto sorted = hashes;
+	std::sort(sorted.begin(), sorted.end());
+	BENCHMARK("insert sorted")
+	{
+		hashmap_t map;
+		for (const auto& hash : sorted) {
+			map.insert(key_t{ hash }, {});
+		}
+		return map;
+	};
+
+	BENCHMARK("assign sorted")
+	{
+		std::vector<std::pair<key_t, bsa::tes3::file>> values;
+		values.reserve(sorted.size());
+		for (const auto& hash : sorted) {
+			values.emplace_back(key_t{ hash }, bsa::tes3::file{});
+		}
+		hashmap_t map;
+		map.assign(std::move(values));
+		return map;
+	};
+
+	const auto map = build();
+	BENCHMARK("lookup")
+	{
+		std::size_t found = 0;
+		for (const auto& hash : hashes) {
+			found += map.find(hash) != map.end() ? 1 : 0;
+		}
+		return found;
+	};
+
+	BENCHMARK_ADVANCED("teardown")(Catch::Benchmark::Chronometer a_meter)
+	{
+		std::vector<Catch::Benchmark::destructable_object<hashmap_t>> maps(a_meter.runs());
+		for (auto& m : maps) {
+			m.construct(build());
+		}
+		a_meter.measure([&](int a_idx) { maps[a_idx].destruct(); });
+	};
+}
+
+TEST_CASE("bsa::detail::normalize_path benchmarks", "[.][benchmark][common]")
+{
+	const auto paths = make_paths(100'000);
+
+	BENCHMARK_ADVANCED("reference")(Catch::Benchmark::Chronometer a_meter)
+	{
+		std::vector<std::vector<std::string>> copies(a_meter.runs(), paths);
+		a_meter.measure([&](int a_idx) {
+			for (auto& path : copies[a_idx]) {
+				normalize_path_reference(path);
+			}
+		});
+	};
+
+	BENCHMARK_ADVANCED("normalize_path")(Catch::Benchmark::Chronometer a_meter)
+	{
+		std::vector<std::vector<std::string>> copies(a_meter.runs(), paths);
+		a_meter.measure([&](int a_idx) {
+			for (auto& path : copies[a_idx]) {
+				bsa::detail::normalize_path(path);
+			}
+		});
+	};
+}
+
+TEST_CASE("bsa::detail::read_zstring benchmarks", "[.][benchmark][common]")
+{
+	const auto table = []() {
+		std::string result;
+		for (const auto& path : make_paths(100'000)) {
+			result += path.substr(path.find_last_of("/\\"sv) + 1);
+			result += '\0';
+		}
+		return result;
+	}();
+	const auto bytes = std::as_bytes(std::span{ table.data(), table.size() });
+
+	BENCHMARK("byte at a time")
+	{
+		bsa::detail::istream_t in{ bytes, bsa::copy_type::shallow };
+		std::size_t total = 0;
+		for (std::size_t i = 0; i < 100'000; ++i) {
+			const auto first = in->tell();
+			while (std::get<0>(in->read<char>()) != '\0') {}
+			total += static_cast<std::size_t>(in->tell() - first);
+		}
+		return total;
+	};
+
+	BENCHMARK("read_zstring")
+	{
+		bsa::detail::istream_t in{ bytes, bsa::copy_type::shallow };
+		std::size_t total = 0;
+		for (std::size_t i = 0; i < 100'000; ++i) {
+			total += bsa::detail::read_zstring(in).size();
+		}
+		return total;
+	};
+
+	BENCHMARK("read_zstrings")
+	{
+		bsa::detail::istream_t in{ bytes, bsa::copy_type::shallow };
+		return bsa::detail::read_zstrings(in, 100'000);
+	};
+}
+
+TEST_CASE("bsa::tes4::hashing allocation benchmarks", "[.][benchmark][common]")
+{
+	const auto paths = make_paths(100'000);
+
+	BENCHMARK("hash_file_in_place (copying)")
+	{
+		std::uint32_t result = 0;
+		for (const auto& path : paths) {
+			auto copy = path;
+			result ^= bsa::tes4::hashing::hash_file_in_place(copy).crc;
+		}
+		return result;
+	};
+
+	BENCHMARK("hash_file (string_view)")
+	{
+		std::uint32_t result = 0;
+		for (const auto& path : paths) {
+			result ^= bsa::tes4::hashing::hash_file(std::string_view{ path }).crc;
+		}
+		return result;
+	};
+
+	const auto before = allocations.load();
+	for (const auto& path : paths) {
+		[[maybe_unused]] const auto h = bsa::tes4::hashing::hash_file(std::string_view{ path });
+	}
+	REQUIRE(allocations.load() == before);
+}
+
+TEST_CASE("batch hashing benchmarks", "[.][benchmark][common]")
+{
+	const auto strings = make_paths(1'000'000);
+	const std::vector<std::string_view> paths(strings.begin(), strings.end());
+	std::vector<bsa::fo4::hashing::hash> hashes(paths.size());
+	const auto executor = bsa::make_thread_executor();
+
+	BENCHMARK("1M paths, one at a time")
+	{
+		for (std::size_t i = 0; i < paths.size(); ++i) {
+			hashes[i] = bsa::fo4::hashing::hash_file(paths[i]);
+		}
+		return hashes.back().file;
+	};
+
+	BENCHMARK("1M paths, serial batch")
+	{
+		bsa::fo4::hashing::hash_files(paths, hashes, {});
+		return hashes.back().file;
+	};
+
+	BENCHMARK("1M paths, threaded batch")
+	{
+		bsa::fo4::hashing::hash_files(paths, hashes, executor);
+		return hashes.back().file;
+	};
 }
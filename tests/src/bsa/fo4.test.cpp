@@ -5,10 +5,12 @@
 #include <cstdint>
 #include <cstring>
 #include <filesystem>
+#include <random>
 #include <span>
 #include <string>
 #include <string_view>
 #include <utility>
+#include <vector>
 
 #include <DirectXTex.h>
 
@@ -200,6 +202,60 @@ TEST_CASE("bsa::fo4::hashing", "[src][fo4][hashing]")
 		REQUIRE(h(R"(Textures\Terrain\SanctuaryHillsWorld\SanctuaryHillsWorld.4.76.-24.DDS)"sv) == hash_t{ 0x71560B31, 0x00736464, 0x49AAA5E1 });
 		REQUIRE(h(R"(Sound\Voice\Fallout4.esm\NPCMTravisMiles\000A6032_1.fuz)"sv) == hash_t{ 0x34402DE0, 0x007A7566, 0xF186D761 });
 	}
+
+	SECTION("hashes are stable across every length of path component")
+	{
+		using hash_t = bsa::fo4::hashing::hash;
+		const auto h = [](std::string_view a_path) noexcept {
+			return bsa::fo4::hashing::hash_file(a_path);
+		};
+
+		REQUIRE(h(R"(meshes\a\b.nif)"sv) == hash_t{ 0xA3BC0074, 0x0066696E, 0xC0600765 });
+		REQUIRE(h(R"(meshes\ab\cd.nif)"sv) == hash_t{ 0x040F9D25, 0x0066696E, 0x9EA4F5A4 });
+		REQUIRE(h(R"(meshes\abc\def.nif)"sv) == hash_t{ 0xF3853873, 0x0066696E, 0x059EF3E6 });
+		REQUIRE(h(R"(meshes\abcd\efgh.nif)"sv) == hash_t{ 0x2977A4A9, 0x0066696E, 0x03B37CFF });
+		REQUIRE(h(R"(meshes\abcde\fghij.nif)"sv) == hash_t{ 0xEF1F8F67, 0x0066696E, 0x10D9C926 });
+		REQUIRE(h(R"(meshes\abcdef\ghijkl.nif)"sv) == hash_t{ 0x7DD06A0E, 0x0066696E, 0x76CC9859 });
+		REQUIRE(h(R"(meshes\abcdefg\hijklmn.nif)"sv) == hash_t{ 0x9393280F, 0x0066696E, 0xC117D133 });
+		REQUIRE(h(R"(meshes\abcdefgh\ijklmnop.nif)"sv) == hash_t{ 0xE7F6024E, 0x0066696E, 0xFC789FAD });
+		REQUIRE(h(R"(meshes\abcdefghi\jklmnopqr.nif)"sv) == hash_t{ 0x2529934C, 0x0066696E, 0x9CF57E36 });
+		REQUIRE(h(R"(meshes\abcdefghij\klmnopqrst.nif)"sv) == hash_t{ 0xD4CBB672, 0x0066696E, 0x6241E8A1 });
+		REQUIRE(h(R"(meshes\abcdefghijk\lmnopqrstuv.nif)"sv) == hash_t{ 0x8DE548BA, 0x0066696E, 0x7BD36A46 });
+		REQUIRE(h(R"(meshes\abcdefghijkl\mnopqrstuvwx.nif)"sv) == hash_t{ 0xCCC477EF, 0x0066696E, 0xDBC01ABC });
+		REQUIRE(h(R"(meshes\abcdefghijklm\nopqrstuvwxyz.nif)"sv) == hash_t{ 0x628D6297, 0x0066696E, 0xF10F2258 });
+		REQUIRE(h(R"(meshes\abcdefghijklmn\opqrstuvwxyz01.nif)"sv) == hash_t{ 0xBC69157B, 0x0066696E, 0xCF4B9ABB });
+		REQUIRE(h(R"(meshes\abcdefghijklmno\pqrstuvwxyz0123.nif)"sv) == hash_t{ 0x441D2765, 0x0066696E, 0x81715D57 });
+		REQUIRE(h(R"(meshes\abcdefghijklmnop\qrstuvwxyz012345.nif)"sv) == hash_t{ 0x34AD9733, 0x0066696E, 0xA58BC436 });
+		REQUIRE(h(R"(meshes\abcdefghijklmnopq\rstuvwxyz01234567.nif)"sv) == hash_t{ 0x8D9B41A9, 0x0066696E, 0xE81D5FF7 });
+	}
+
+	SECTION("hashes can be produced at compile time")
+	{
+		using hash_t = bsa::fo4::hashing::hash;
+		using namespace bsa::fo4::hashing::literals;
+		static_assert(R"(Interface\Pipboy_StatsPage.swf)"_file_hash == hash_t{ 0x2F26E4D0, 0x00667773, 0xD2FDF873 });
+		static_assert(R"(meshes\abcdefghijklmnopq\rstuvwxyz01234567.nif)"_file_hash == hash_t{ 0x8D9B41A9, 0x0066696E, 0xE81D5FF7 });
+
+		REQUIRE("Textures/Effects/ColorBlackZeroAlphaUtility.DDS"_file_hash ==
+				bsa::fo4::hashing::hash_file("Textures/Effects/ColorBlackZeroAlphaUtility.DDS"sv));
+	}
+}
+
+TEST_CASE("bsa::fo4::hashing benchmarks", "[.][benchmark][fo4]")
+{
+	std::vector<std::string> paths;
+	for (std::size_t i = 0; i < 100'000; ++i) {
+		paths.push_back("Textures\\Terrain\\Commonwealth\\Commonwealth.4."s + std::to_string(i) + "_msn.dds"s);
+	}
+
+	BENCHMARK("hash_file")
+	{
+		std::uint32_t result = 0;
+		for (const auto& path : paths) {
+			result ^= bsa::fo4::hashing::hash_file(path).file;
+		}
+		return result;
+	};
 }
 
 TEST_CASE("bsa::fo4::chunk", "[src][fo4][vfs]")
@@ -213,6 +269,44 @@ TEST_CASE("bsa::fo4::chunk", "[src][fo4][vfs]")
 		REQUIRE(chunk.mips.first == 0);
 		REQUIRE(chunk.mips.last == 0);
 	}
+
+	SECTION("every compression preset produces a chunk which decompresses to the original")
+	{
+		std::mt19937 rng;
+		std::vector<std::byte> payload(0x10000);
+		for (auto& b : payload) {
+			b = static_cast<std::byte>(rng() % 16);
+		}
+
+		for (const auto format : { bsa::fo4::compression_format::zip, bsa::fo4::compression_format::lz4 }) {
+			bsa::fo4::chunk original;
+			original.set_data(std::span{ payload });
+			original.compress({ .compression_format_ = format });
+
+			const auto compress = [&](bsa::compression_preset a_preset) {
+				bsa::fo4::chunk chunk;
+				chunk.set_data(std::span{ payload });
+				chunk.compress({
+					.compression_format_ = format,
+					.compression_preset_ = a_preset,
+				});
+				REQUIRE(chunk.compressed());
+
+				std::vector<std::byte> buffer(payload.size());
+				chunk.decompress_into(buffer, format);
+				assert_byte_equality(buffer, payload);
+				return chunk;
+			};
+
+			const auto fast = compress(bsa::compression_preset::fast);
+			const auto normal = compress(bsa::compression_preset::normal);
+			const auto max = compress(bsa::compression_preset::max);
+
+			assert_byte_equality(normal.as_bytes(), original.as_bytes());
+			REQUIRE(max.size() <= normal.size());
+			REQUIRE(normal.size() <= fast.size());
+		}
+	}
 }
 
 TEST_CASE("bsa::fo4::file", "[src][fo4][vfs]")
@@ -363,7 +457,7 @@ TEST_CASE("bsa::fo4::archive", "[src][fo4][archive]")
 		test(true);
 		test(false);
 
-		for (auto& f : in) {
+		for (auto&& f : in) {
 			for (auto& c : f.second) {
 				c.compress({});
 			}
@@ -373,6 +467,144 @@ TEST_CASE("bsa::fo4::archive", "[src][fo4][archive]")
 		test(false);
 	}
 
+	SECTION("writing chunk data concurrently is identical to writing it sequentially")
+	{
+		const std::filesystem::path root{ "fo4_parallel_write_test"sv };
+		std::filesystem::create_directories(root);
+
+		std::mt19937 rng;
+		bsa::fo4::archive bsa;
+		for (std::size_t i = 0; i < 64; ++i) {
+			bsa::fo4::file f;
+			for (std::size_t j = 0; j <= i % 3; ++j) {
+				std::vector<std::byte> payload(rng() % 0x1000);
+				for (auto& b : payload) {
+					b = static_cast<std::byte>(rng() % 8);
+				}
+
+				auto& c = f.emplace_back();
+				c.set_data(std::move(payload));
+				if ((i + j) % 2 == 0) {
+					c.compress({});
+				}
+			}
+			REQUIRE(bsa.insert("dir"s + std::to_string(i % 8) + "/file"s + std::to_string(i) + ".txt"s, std::move(f)).second);
+		}
+
+		for (const auto strings : { true, false }) {
+			const bsa::fo4::archive::meta_info meta{ .format_ = bsa::fo4::format::general, .strings = strings };
+			binary_io::any_ostream os{ std::in_place_type<binary_io::memory_ostream> };
+			bsa.write(os, meta);
+
+			const auto path = root / "out.ba2"sv;
+			bsa.write(path, meta, bsa::make_thread_executor(4));
+			const auto disk = map_file(path);
+			assert_byte_equality(
+				os.get<binary_io::memory_ostream>().rdbuf(),
+				std::span{ disk.data(), disk.size() });
+		}
+	}
+
+	SECTION("compressing chunks as they are written is identical to compressing them up front")
+	{
+		const std::filesystem::path root{ "fo4_streaming_write_test"sv };
+		std::filesystem::create_directories(root);
+
+		const auto payloads = make_payloads(64);
+
+		const auto pack = [&]() {
+			bsa::fo4::archive bsa;
+			for (std::size_t i = 0; i < payloads.size(); i += 2) {
+				bsa::fo4::file f;
+				for (std::size_t j = i; j < i + 2; ++j) {
+					auto& c = f.emplace_back();
+					c.set_data(std::span{ payloads[j] });
+					if (j % 5 == 0) {
+						c.compress({});
+					}
+				}
+				REQUIRE(bsa.insert("dir"s + std::to_string(i % 8) + "/file"s + std::to_string(i) + ".txt"s, std::move(f)).second);
+			}
+			return bsa;
+		};
+
+		for (const auto strings : { true, false }) {
+			const bsa::fo4::archive::meta_info meta{ .format_ = bsa::fo4::format::general, .strings = strings };
+
+			auto expected = pack();
+			expected.compress_all({}, bsa::make_thread_executor(4));
+			binary_io::any_ostream eos{ std::in_place_type<binary_io::memory_ostream> };
+			expected.write(eos, meta);
+			const auto& bytes = eos.get<binary_io::memory_ostream>().rdbuf();
+
+			const auto bsa = pack();
+			binary_io::any_ostream os{ std::in_place_type<binary_io::memory_ostream> };
+			bsa.write(os, meta, {}, bsa::make_thread_executor(4));
+			assert_byte_equality(bytes, os.get<binary_io::memory_ostream>().rdbuf());
+
+			const auto path = root / "out.ba2"sv;
+			bsa.write(path, meta, {}, bsa::make_thread_executor(4));
+			const auto disk = map_file(path);
+			assert_byte_equality(bytes, std::span{ disk.data(), disk.size() });
+
+			// the archive itself is left untouched
+			const auto original = pack();
+			for (const auto& [key, file] : bsa) {
+				const auto& other = *original[key];
+				REQUIRE(file.size() == other.size());
+				for (std::size_t i = 0; i < file.size(); ++i) {
+					REQUIRE(file[i].compressed() == other[i].compressed());
+				}
+			}
+		}
+	}
+
+	SECTION("extracting files to disk is identical to extracting them in memory")
+	{
+		const std::filesystem::path root{ "fo4_extract_test"sv };
+		std::filesystem::create_directories(root);
+
+		const auto payloads = make_payloads(32, 1);
+
+		const auto in = root / "in.ba2"sv;
+		{
+			bsa::fo4::archive bsa;
+			for (std::size_t i = 0; i < payloads.size(); i += 4) {
+				bsa::fo4::file f;
+				for (std::size_t j = i; j < i + 1 + i % 3; ++j) {
+					auto& c = f.emplace_back();
+					c.set_data(std::span{ payloads[j] });
+					if (i % 8 == 4 && j == i) {
+						c.compress({});
+					}
+				}
+				REQUIRE(bsa.insert("dir/file"s + std::to_string(i) + ".txt"s, std::move(f)).second);
+			}
+			bsa.write(in, { .format_ = bsa::fo4::format::general });
+		}
+
+		const std::vector<std::byte> garbage(0x4000, std::byte{ 0xFF });
+		bsa::fo4::file leftover;
+		leftover.emplace_back().set_data(std::span{ garbage });
+
+		bsa::fo4::archive bsa;
+		bsa.read(in);
+		for (const auto& [key, file] : bsa) {
+			binary_io::any_ostream os{ std::in_place_type<binary_io::memory_ostream> };
+			file.write(os, {});
+
+			// whatever was on disk before is replaced entirely
+			const auto out = root / "out.txt"sv;
+			leftover.write(out, {});
+			file.write(out, {});
+
+			const auto disk = map_file(out);
+			assert_byte_equality(
+				os.get<binary_io::memory_ostream>().rdbuf(),
+				std::span{ disk.data(), disk.size() });
+		}
+	}
+
 	SECTION("archives will bail on malformed inputs")
 	{
 		const std::filesystem::path root{ "fo4_invalid_test"sv };
@@ -461,6 +693,40 @@ TEST_CASE("bsa::fo4::archive", "[src][fo4][archive]")
 					assert_byte_equality(archC.as_bytes(), std::span{ disk.data(), disk.size() });
 				}
 			}
+
+			bsa::fo4::archive repacked;
+			for (const auto& [key, file] : ba2) {
+				bsa::fo4::file f;
+				for (const auto& c : file) {
+					auto& copy = f.emplace_back();
+					copy.set_data(std::vector(c.as_bytes().begin(), c.as_bytes().end()), c.decompressed_size());
+					copy.decompress(meta.compression_format_);
+				}
+				REQUIRE(repacked.insert(key.name(), std::move(f)).second);
+			}
+			repacked.compress_all({ .compression_level_ = compression }, bsa::make_thread_executor(4));
+			for (const auto& [key, file] : ba2) {
+				const auto it = repacked.find(key.name());
+				REQUIRE(it != repacked.end());
+				REQUIRE(it->second.size() == file.size());
+				for (std::size_t i = 0; i < file.size(); ++i) {
+					REQUIRE(it->second[i].compressed());
+					assert_byte_equality(it->second[i].as_bytes(), file[i].as_bytes());
+				}
+			}
+
+			ba2.decompress_all(meta.compression_format_, bsa::make_thread_executor(4));
+			for (const auto& entry : std::filesystem::recursive_directory_iterator(root / "data"sv)) {
+				if (entry.is_regular_file()) {
+					const auto p = std::filesystem::relative(entry.path(), root / "data"sv);
+					const auto arch = ba2[p.string()];
+					REQUIRE(arch);
+					REQUIRE(!arch->front().compressed());
+
+					const auto disk = map_file(entry.path());
+					assert_byte_equality(arch->front().as_bytes(), std::span{ disk.data(), disk.size() });
+				}
+			}
 		}
 	}
 
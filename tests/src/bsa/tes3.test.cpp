@@ -7,10 +7,12 @@
 #include <filesystem>
 #include <limits>
 #include <memory>
+#include <optional>
 #include <span>
 #include <string>
 #include <string_view>
 #include <utility>
+#include <vector>
 
 #include "catch2.hpp"
 #include <mmio/mmio.hpp>
@@ -68,6 +70,16 @@ TEST_CASE("bsa::tes3::hashing", "[src][tes3][hashing]")
 		const bsa::tes3::hashing::hash rhs{ 1, 0 };
 		REQUIRE(lhs < rhs);
 	}
+
+	SECTION("hashes can be produced at compile time")
+	{
+		using namespace bsa::tes3::hashing::literals;
+		static_assert("meshes/c/artifact_bloodring_01.nif"_file_hash.numeric() == 0x1C3C1149920D5F0C);
+		static_assert("Meshes\\R\\xkwama worker.nif"_file_hash.numeric() == 0x6D446E352C3F5A1E);
+
+		REQUIRE("/Textures/TX_Rope_Woven.dds/"_file_hash == bsa::tes3::hashing::hash_file("/Textures/TX_Rope_Woven.dds/"sv));
+		REQUIRE(""_file_hash == bsa::tes3::hashing::hash_file(""sv));
+	}
 }
 
 TEST_CASE("bsa::tes3::file", "[src][tes3][vfs]")
@@ -95,9 +107,68 @@ TEST_CASE("bsa::tes3::archive", "[src][tes3][archive]")
 	{
 		const std::filesystem::path root{ "tes3_read_test"sv };
 
-		bsa::tes3::archive bsa;
-		bsa.read(root / "test.bsa"sv);
-		REQUIRE(!bsa.empty());
+		for (const auto ownership : { bsa::map_ownership::shared, bsa::map_ownership::archive }) {
+			bsa::tes3::archive bsa;
+			bsa.read({ root / "test.bsa"sv, ownership });
+			REQUIRE(!bsa.empty());
+
+			constexpr std::array files{
+				"characters/character_0000.png"sv,
+				"share/License.txt"sv,
+			};
+
+			for (const auto& name : files) {
+				const auto p = root / name;
+				REQUIRE(std::filesystem::exists(p));
+
+				const auto archived = bsa[name];
+				REQUIRE(archived);
+				REQUIRE(archived->size() == std::filesystem::file_size(p));
+
+				const auto disk = map_file(p);
+
+				assert_byte_equality(archived->as_bytes(), std::span{ disk.data(), disk.size() });
+			}
+		}
+	}
+
+	SECTION("archives which own their mapping share it between copies")
+	{
+		const std::filesystem::path root{ "tes3_read_test"sv };
+
+		bsa::tes3::archive copy;
+		{
+			bsa::tes3::archive bsa;
+			bsa.read({ root / "test.bsa"sv, bsa::map_ownership::archive });
+			copy = bsa;
+		}
+
+		const auto archived = copy["share/License.txt"sv];
+		REQUIRE(archived);
+		REQUIRE(archived.operator->() == &copy.find("share/License.txt"sv)->second);
+
+		const auto disk = map_file(root / "share/License.txt"sv);
+		assert_byte_equality(archived->as_bytes(), std::span{ disk.data(), disk.size() });
+	}
+
+	SECTION("names are owned by the archive, and are shared between copies of it")
+	{
+		const std::filesystem::path root{ "tes3_read_test"sv };
+		auto disk = map_file(root / "test.bsa"sv);
+
+		bsa::tes3::archive copy;
+		{
+			bsa::tes3::archive bsa;
+			bsa.read({ std::span{ disk.data(), disk.size() }, bsa::copy_type::deep });
+			copy = bsa;
+
+			// copies share the names of the original, rather than copying each of them
+			REQUIRE(copy.size() == bsa.size());
+			for (auto l = copy.begin(), r = bsa.begin(); l != copy.end(); ++l, ++r) {
+				REQUIRE(l->first.name().data() == r->first.name().data());
+			}
+		}
+		disk.close();
 
 		constexpr std::array files{
 			"characters/character_0000.png"sv,
@@ -105,16 +176,45 @@ TEST_CASE("bsa::tes3::archive", "[src][tes3][archive]")
 		};
 
 		for (const auto& name : files) {
-			const auto p = root / name;
-			REQUIRE(std::filesystem::exists(p));
-
-			const auto archived = bsa[name];
-			REQUIRE(archived);
-			REQUIRE(archived->size() == std::filesystem::file_size(p));
+			const auto it = copy.find(name);
+			REQUIRE(it != copy.end());
+			REQUIRE(it->first.name() == simple_normalize(name));
+		}
+	}
 
-			const auto disk = map_file(p);
+	SECTION("keys copied out of an archive keep their names after the archive is destroyed")
+	{
+		const std::filesystem::path root{ "tes3_read_test"sv };
+		const auto disk = map_file(root / "test.bsa"sv);
+		const auto read = [&](bsa::tes3::archive& a_archive, bool a_fromPath) {
+			if (a_fromPath) {
+				a_archive.read(root / "test.bsa"sv);
+			} else {
+				a_archive.read({ std::span{ disk.data(), disk.size() }, bsa::copy_type::deep });
+			}
+		};
 
-			assert_byte_equality(archived->as_bytes(), std::span{ disk.data(), disk.size() });
+		for (const bool fromPath : { true, false }) {
+			std::optional<bsa::tes3::archive::key_type> copied;
+			std::optional<bsa::tes3::archive::key_type> moved;
+			std::string expected;
+			{
+				bsa::tes3::archive bsa;
+				read(bsa, fromPath);
+				REQUIRE(!bsa.empty());
+				copied.emplace(bsa.begin()->first);
+				expected = copied->name();
+
+				// moving a key out of the archive must not leave it viewing the archive's names
+				auto moving = bsa.begin()->first;
+				moved.emplace(std::move(moving));
+				bsa.read(root / "test.bsa"sv);
+			}
+
+			for (const auto& key : { *copied, *moved }) {
+				REQUIRE(key.name() == expected);
+				REQUIRE(key.hash() == bsa::tes3::hashing::hash_file(expected));
+			}
 		}
 	}
 
@@ -262,3 +362,44 @@ TEST_CASE("bsa::tes3::archive", "[src][tes3][archive]")
 			});
 	}
 }
+
+TEST_CASE("bsa::tes3::archive benchmarks", "[.][benchmark][tes3]")
+{
+	const std::filesystem::path root{ "tes3_benchmark"sv };
+	const auto path = root / "large.bsa"sv;
+	{
+		constexpr std::array<std::byte, 16> payload{};
+		bsa::tes3::archive bsa;
+		for (std::size_t i = 0; i < 200'000; ++i) {
+			bsa::tes3::file f;
+			f.set_data(std::span{ payload });
+			bsa.insert("meshes/d"s + std::to_string(i / 100) + "/f"s + std::to_string(i) + ".nif"s, std::move(f));
+		}
+		std::filesystem::create_directories(root);
+		bsa.write(path);
+	}
+
+	for (const auto ownership : { bsa::map_ownership::shared, bsa::map_ownership::archive }) {
+		const auto suffix = ownership == bsa::map_ownership::shared ? " (shared mapping)"s : " (archive mapping)"s;
+
+		const auto read = [&]() {
+			bsa::tes3::archive bsa;
+			bsa.read({ path, ownership });
+			return bsa;
+		};
+
+		BENCHMARK("read"s + suffix)
+		{
+			return read();
+		};
+
+		BENCHMARK_ADVANCED("destroy"s + suffix)(Catch::Benchmark::Chronometer a_meter)
+		{
+			std::vector<Catch::Benchmark::destructable_object<bsa::tes3::archive>> archives(a_meter.runs());
+			for (auto& archive : archives) {
+				archive.construct(read());
+			}
+			a_meter.measure([&](int a_idx) { archives[a_idx].destruct(); });
+		};
+	}
+}
@@ -1,15 +1,21 @@
 #include "utility.hpp"
 
+#include <algorithm>
 #include <array>
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <exception>
 #include <filesystem>
 #include <iterator>
 #include <limits>
 #include <memory>
+#include <random>
 #include <span>
+#include <string>
 #include <string_view>
 #include <system_error>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -25,6 +31,36 @@ static_assert(assert_nothrowable<bsa::tes4::directory>());
 static_assert(assert_nothrowable<bsa::tes4::directory::key, false>());
 static_assert(assert_nothrowable<bsa::tes4::archive>());
 
+namespace
+{
+	// spreads the payloads over eight directories (plus an empty one), and compresses every
+	// a_compressEvery'th file up front
+	[[nodiscard]] auto pack_payloads(
+		std::span<const std::vector<std::byte>> a_payloads,
+		bsa::tes4::archive_flag a_flags,
+		bsa::tes4::version a_version,
+		std::size_t a_compressEvery)
+		-> bsa::tes4::archive
+	{
+		bsa::tes4::archive bsa;
+		bsa.archive_flags(a_flags);
+		for (std::size_t i = 0; i < 8; ++i) {
+			bsa::tes4::directory d;
+			for (std::size_t j = i; j < a_payloads.size(); j += 8) {
+				bsa::tes4::file f;
+				f.set_data(std::span{ a_payloads[j] });
+				if (j % a_compressEvery == 0) {
+					f.compress({ .version_ = a_version });
+				}
+				REQUIRE(d.insert("file"s + std::to_string(j) + ".txt"s, std::move(f)).second);
+			}
+			REQUIRE(bsa.insert("dir"s + std::to_string(i), std::move(d)).second);
+		}
+		REQUIRE(bsa.insert("empty"sv, bsa::tes4::directory{}).second);
+		return bsa;
+	}
+}
+
 TEST_CASE("bsa::tes4::hashing", "[src][tes4][hashing]")
 {
 	SECTION("validate directory hashes")
@@ -128,6 +164,74 @@ TEST_CASE("bsa::tes4::hashing", "[src][tes4][hashing]")
 
 		REQUIRE(h1 == h2);
 	}
+
+	SECTION("the unrolled crc matches the reference loop for every block and tail length")
+	{
+		const auto reference = [](std::string_view a_bytes) noexcept {
+			std::uint32_t crc = 0;
+			for (const auto c : a_bytes) {
+				crc = static_cast<std::uint8_t>(c) + crc * 0x1003Fu;
+			}
+			return crc;
+		};
+
+		std::mt19937 rng;
+		using pattern_t = char (*)(std::size_t) noexcept;
+		const std::array<pattern_t, 3> patterns{
+			[](std::size_t a_idx) noexcept { return static_cast<char>('a' + a_idx % 26); },
+			[](std::size_t) noexcept { return '\xFF'; },
+			[](std::size_t a_idx) noexcept { return static_cast<char>(0x80u | (a_idx * 37u)); },
+		};
+
+		for (const auto& pattern : patterns) {
+			std::string bytes;
+			for (std::size_t length = 0; length <= 24; ++length) {
+				REQUIRE(bsa::tes4::detail::crc32(bytes) == reference(bytes));
+				bytes.push_back(pattern(length));
+			}
+		}
+
+		for (std::size_t length = 0; length <= 24; ++length) {
+			std::string bytes(length, '\0');
+			for (auto& c : bytes) {
+				c = static_cast<char>(rng());
+			}
+			REQUIRE(bsa::tes4::detail::crc32(bytes) == reference(bytes));
+		}
+	}
+
+	SECTION("hashes can be produced at compile time")
+	{
+		using namespace bsa::tes4::hashing::literals;
+		static_assert("textures/architecture/windhelm"_directory_hash.numeric() == 0xC1D97EBE741E6C6D);
+		static_assert("elder_council_amulet_n.dds"_file_hash.numeric() == 0xDC531E2F6516DFEE);
+		static_assert("Mar"
+					  "\xED"
+					  "a_F.fuz"_file_hash.numeric() == 0x690E07826D075F66);
+
+		REQUIRE("Sound/Voice/Skyrim.esm/MaleUniqueDBGuardian/"_directory_hash ==
+				bsa::tes4::hashing::hash_directory("Sound/Voice/Skyrim.esm/MaleUniqueDBGuardian/"sv));
+		REQUIRE("users/john/test.txt"_file_hash == bsa::tes4::hashing::hash_file("test.txt"sv));
+		REQUIRE(".gitignore"_file_hash == bsa::tes4::hashing::hash_file(".gitignore"sv));
+		REQUIRE(""_directory_hash == "."_directory_hash);
+	}
+}
+
+TEST_CASE("bsa::tes4::hashing benchmarks", "[.][benchmark][tes4]")
+{
+	std::vector<std::string> directories;
+	for (std::size_t i = 0; i < 100'000; ++i) {
+		directories.push_back("meshes\\actors\\character\\facegendata\\facegeom\\skyrim.esm\\"s + std::to_string(i));
+	}
+
+	BENCHMARK("hash_directory")
+	{
+		std::uint32_t result = 0;
+		for (const auto& directory : directories) {
+			result ^= bsa::tes4::hashing::hash_directory(directory).crc;
+		}
+		return result;
+	};
 }
 
 TEST_CASE("bsa::tes4::directory", "[src][tes4][vfs]")
@@ -167,6 +271,75 @@ TEST_CASE("bsa::tes4::file", "[src][tes4][vfs]")
 		f.clear();
 		REQUIRE(f.empty());
 	}
+
+	SECTION("a file which fails to decompress doesn't affect the next file to decompress")
+	{
+		std::vector<std::byte> payload(0x1000);
+		for (std::size_t i = 0; i < payload.size(); ++i) {
+			payload[i] = static_cast<std::byte>(i % 7);
+		}
+
+		for (const auto version : { bsa::tes4::version::tes4, bsa::tes4::version::sse }) {
+			bsa::tes4::file good;
+			good.set_data(std::span{ payload });
+			good.compress({ .version_ = version });
+
+			std::vector<std::byte> corrupt(good.as_bytes().begin(), good.as_bytes().end());
+			if (version == bsa::tes4::version::sse) {
+				// the first block claims to be larger than any block can be, which only fails
+				// once the frame header has been consumed
+				std::fill_n(corrupt.begin() + 7, 4, std::byte{ 0x7F });
+			} else {
+				// the stream ends partway through
+				corrupt.resize(corrupt.size() / 2);
+			}
+			bsa::tes4::file bad;
+			bad.set_data(std::span{ corrupt }, good.decompressed_size());
+
+			std::vector<std::byte> buffer(payload.size());
+			REQUIRE_THROWS_AS(bad.decompress_into(buffer, { .version_ = version }), bsa::compression_error);
+			good.decompress_into(buffer, { .version_ = version });
+			assert_byte_equality(buffer, payload);
+		}
+	}
+
+	SECTION("every compression preset produces a file which decompresses to the original")
+	{
+		std::mt19937 rng;
+		std::vector<std::byte> payload(0x10000);
+		for (auto& b : payload) {
+			b = static_cast<std::byte>(rng() % 16);
+		}
+
+		for (const auto version : { bsa::tes4::version::tes4, bsa::tes4::version::sse }) {
+			bsa::tes4::file original;
+			original.set_data(std::span{ payload });
+			original.compress({ .version_ = version });
+
+			const auto compress = [&](bsa::compression_preset a_preset) {
+				bsa::tes4::file f;
+				f.set_data(std::span{ payload });
+				f.compress({
+					.version_ = version,
+					.compression_preset_ = a_preset,
+				});
+				REQUIRE(f.compressed());
+
+				std::vector<std::byte> buffer(payload.size());
+				f.decompress_into(buffer, { .version_ = version });
+				assert_byte_equality(buffer, payload);
+				return f;
+			};
+
+			const auto fast = compress(bsa::compression_preset::fast);
+			const auto normal = compress(bsa::compression_preset::normal);
+			const auto max = compress(bsa::compression_preset::max);
+
+			assert_byte_equality(normal.as_bytes(), original.as_bytes());
+			REQUIRE(max.size() <= normal.size());
+			REQUIRE(normal.size() <= fast.size());
+		}
+	}
 }
 
 TEST_CASE("bsa::tes4::archive", "[src][tes4][archive]")
@@ -244,7 +417,15 @@ TEST_CASE("bsa::tes4::archive", "[src][tes4][archive]")
 				original.compress({ .version_ = version });
 
 				REQUIRE(read->decompressed_size() == original.decompressed_size());
-				assert_byte_equality(read->as_bytes(), original.as_bytes());
+#ifdef BSA_USE_LIBDEFLATE
+				// libdeflate compresses zlib streams differently than archive.exe does
+				const bool identical = version == bsa::tes4::version::sse;
+#else
+				const bool identical = true;
+#endif
+				if (identical) {
+					assert_byte_equality(read->as_bytes(), original.as_bytes());
+				}
 
 				read->decompress({ .version_ = version });
 				assert_byte_equality(read->as_bytes(), std::span{ origsrc.data(), origsrc.size() });
@@ -262,6 +443,78 @@ TEST_CASE("bsa::tes4::archive", "[src][tes4][archive]")
 		}
 	}
 
+	SECTION("we can decompress entire archives in parallel")
+	{
+		const std::filesystem::path root{ "tes4_compression_test"sv };
+		for (const auto name : { "test_104.bsa"sv, "test_105.bsa"sv }) {
+			bsa::tes4::archive bsa;
+			const auto version = bsa.read(root / name);
+			bsa.decompress_all({ .version_ = version }, bsa::make_thread_executor(4));
+
+			for (const auto file : { "License.txt"sv, "Preview.png"sv }) {
+				const auto read = bsa["."sv][file];
+				REQUIRE(read);
+				REQUIRE(!read->compressed());
+
+				const auto disk = map_file(root / file);
+				assert_byte_equality(read->as_bytes(), std::span{ disk.data(), disk.size() });
+			}
+		}
+	}
+
+	SECTION("compressing archives in bulk is identical to compressing files one at a time")
+	{
+		const std::filesystem::path root{ "tes4_compression_test"sv };
+		for (const auto version : { bsa::tes4::version::tes4, bsa::tes4::version::tes5, bsa::tes4::version::sse }) {
+			const auto pack = [&](bool a_bulk) {
+				bsa::tes4::archive bsa;
+				bsa.archive_flags(
+					bsa::tes4::archive_flag::compressed |
+					bsa::tes4::archive_flag::directory_strings |
+					bsa::tes4::archive_flag::file_strings);
+
+				bsa::tes4::directory d;
+				for (const auto name : { "License.txt"sv, "Preview.png"sv }) {
+					bsa::tes4::file f;
+					f.read(
+						root / name,
+						{
+							.version_ = version,
+							.compression_type_ = a_bulk ? bsa::compression_type::decompressed : bsa::compression_type::compressed,
+						});
+					REQUIRE(d.insert(name, std::move(f)).second);
+				}
+				REQUIRE(bsa.insert("."sv, std::move(d)).second);
+
+				if (a_bulk) {
+					bsa.compress_all({ .version_ = version }, bsa::make_thread_executor(4));
+				}
+
+				binary_io::any_ostream os{ std::in_place_type<binary_io::memory_ostream> };
+				bsa.write(os, version);
+				return std::move(os.get<binary_io::memory_ostream>().rdbuf());
+			};
+
+			assert_byte_equality(pack(true), pack(false));
+		}
+	}
+
+	SECTION("we can decompress a subset of an archive")
+	{
+		bsa::tes4::archive bsa;
+		const auto version = bsa.read(std::filesystem::path{ "tes4_compression_test/test_105.bsa"sv });
+
+		const auto license = bsa["."sv]["License.txt"sv];
+		const auto preview = bsa["."sv]["Preview.png"sv];
+		REQUIRE(license);
+		REQUIRE(preview);
+
+		const std::array files{ &*license };
+		bsa::tes4::archive::decompress(files, { .version_ = version });
+		REQUIRE(!license->compressed());
+		REQUIRE(preview->compressed());
+	}
+
 	SECTION("we can read archives written in the xbox format")
 	{
 		const std::filesystem::path root{ "tes4_xbox_read_test"sv };
@@ -315,6 +568,179 @@ TEST_CASE("bsa::tes4::archive", "[src][tes4][archive]")
 			});
 	}
 
+	SECTION("xbox archives are written in the xbox hash order")
+	{
+		constexpr std::size_t dirs = 64;
+		constexpr std::size_t files = 32;
+
+		bsa::tes4::archive bsa;
+		for (std::size_t i = 0; i < dirs; ++i) {
+			bsa::tes4::directory d;
+			for (std::size_t j = 0; j < files; ++j) {
+				REQUIRE(d.insert("file"s + std::to_string(j * 7919 % 1000) + ".nif"s, bsa::tes4::file{}).second);
+			}
+			REQUIRE(bsa.insert("meshes/dir"s + std::to_string(i * 104729 % 1000), std::move(d)).second);
+		}
+		bsa.archive_flags(bsa::tes4::archive_flag::xbox_archive);
+
+		binary_io::any_ostream os{ std::in_place_type<binary_io::memory_ostream> };
+		bsa.write(os, bsa::tes4::version::tes4);
+		const auto bytes = std::span{ os.get<binary_io::memory_ostream>().rdbuf() };
+
+		// hashes are written with their crc in big endian, and xbox archives order them by
+		// the byte reversed numeric value of the hash
+		const auto key_at = [&](std::size_t a_pos) {
+			const std::array order{ 0, 1, 2, 3, 7, 6, 5, 4 };
+			std::uint64_t key = 0;
+			for (const auto i : order) {
+				key = key << 8u | std::to_integer<std::uint64_t>(bytes[a_pos + i]);
+			}
+			return key;
+		};
+
+		constexpr std::size_t header_size = 0x24;
+		constexpr std::size_t record_size = 0x10;
+		const auto directory_keys = [&]() {
+			std::vector<std::uint64_t> keys;
+			for (std::size_t i = 0; i < dirs; ++i) {
+				keys.push_back(key_at(header_size + i * record_size));
+			}
+			return keys;
+		}();
+		REQUIRE(std::is_sorted(directory_keys.begin(), directory_keys.end()));
+		REQUIRE(std::adjacent_find(directory_keys.begin(), directory_keys.end()) == directory_keys.end());
+
+		for (std::size_t i = 0; i < dirs; ++i) {
+			std::vector<std::uint64_t> keys;
+			const auto block = header_size + (dirs + i * files) * record_size;
+			for (std::size_t j = 0; j < files; ++j) {
+				keys.push_back(key_at(block + j * record_size));
+			}
+			REQUIRE(std::is_sorted(keys.begin(), keys.end()));
+		}
+
+		bsa::tes4::archive out;
+		out.read({ bytes });
+		REQUIRE(out.size() == dirs);
+		for (const auto& [key, dir] : bsa) {
+			REQUIRE(out[key.hash()]);
+			REQUIRE(out[key.hash()]->size() == files);
+		}
+	}
+
+	SECTION("writing file data concurrently is identical to writing it sequentially")
+	{
+		const std::filesystem::path root{ "tes4_parallel_write_test"sv };
+		std::filesystem::create_directories(root);
+
+		const auto payloads = make_payloads(64);
+
+		constexpr std::array flags{
+			bsa::tes4::archive_flag::directory_strings | bsa::tes4::archive_flag::file_strings,
+			bsa::tes4::archive_flag::compressed | bsa::tes4::archive_flag::embedded_file_names,
+			bsa::tes4::archive_flag::xbox_archive | bsa::tes4::archive_flag::file_strings,
+		};
+
+		for (const auto version : { bsa::tes4::version::tes4, bsa::tes4::version::sse }) {
+			for (const auto flag : flags) {
+				const auto bsa = pack_payloads(payloads, flag, version, 3);
+				binary_io::any_ostream os{ std::in_place_type<binary_io::memory_ostream> };
+				bsa.write(os, version);
+
+				const auto path = root / "out.bsa"sv;
+				bsa.write(path, version, bsa::make_thread_executor(4));
+				const auto disk = map_file(path);
+				assert_byte_equality(
+					os.get<binary_io::memory_ostream>().rdbuf(),
+					std::span{ disk.data(), disk.size() });
+			}
+		}
+	}
+
+	SECTION("compressing files as they are written is identical to compressing them up front")
+	{
+		const std::filesystem::path root{ "tes4_streaming_write_test"sv };
+		std::filesystem::create_directories(root);
+
+		const auto payloads = make_payloads(64);
+
+		constexpr std::array flags{
+			bsa::tes4::archive_flag::compressed | bsa::tes4::archive_flag::directory_strings | bsa::tes4::archive_flag::file_strings,
+			bsa::tes4::archive_flag::compressed | bsa::tes4::archive_flag::embedded_file_names,
+			bsa::tes4::archive_flag::xbox_archive | bsa::tes4::archive_flag::file_strings,
+		};
+
+		for (const auto version : { bsa::tes4::version::tes4, bsa::tes4::version::sse }) {
+			for (const auto flag : flags) {
+				const auto pack = [&]() {
+					return pack_payloads(payloads, flag, version, 5);
+				};
+
+				auto expected = pack();
+				expected.compress_all({ .version_ = version }, bsa::make_thread_executor(4));
+				binary_io::any_ostream eos{ std::in_place_type<binary_io::memory_ostream> };
+				expected.write(eos, version);
+				const auto& bytes = eos.get<binary_io::memory_ostream>().rdbuf();
+
+				const auto bsa = pack();
+				binary_io::any_ostream os{ std::in_place_type<binary_io::memory_ostream> };
+				bsa.write(os, version, { .version_ = version }, bsa::make_thread_executor(4));
+				assert_byte_equality(bytes, os.get<binary_io::memory_ostream>().rdbuf());
+
+				// files are compressed for the version being written, not the one in the params
+				binary_io::any_ostream dos{ std::in_place_type<binary_io::memory_ostream> };
+				bsa.write(dos, version, {}, bsa::make_thread_executor(4));
+				assert_byte_equality(bytes, dos.get<binary_io::memory_ostream>().rdbuf());
+
+				const auto path = root / "out.bsa"sv;
+				bsa.write(path, version, { .version_ = version }, bsa::make_thread_executor(4));
+				const auto disk = map_file(path);
+				assert_byte_equality(bytes, std::span{ disk.data(), disk.size() });
+
+				// the archive itself is left untouched
+				const auto original = pack();
+				for (const auto& [key, dir] : bsa) {
+					for (const auto& [name, file] : dir) {
+						REQUIRE(file.compressed() == original[key.hash()][name.hash()]->compressed());
+					}
+				}
+			}
+		}
+	}
+
+	SECTION("compressing files as they are written works across many windows")
+	{
+		// more files than fit within a single window
+		constexpr auto version = bsa::tes4::version::sse;
+		const auto pack = [&]() {
+			bsa::tes4::archive bsa;
+			bsa.archive_flags(bsa::tes4::archive_flag::compressed);
+			for (std::size_t i = 0; i < 10; ++i) {
+				bsa::tes4::directory d;
+				for (std::size_t j = 0; j < 500; ++j) {
+					const auto name = "file"s + std::to_string(i * 500 + j) + ".txt"s;
+					bsa::tes4::file f;
+					f.set_data(std::vector<std::byte>(name.size(), static_cast<std::byte>(j)));
+					REQUIRE(d.insert(name, std::move(f)).second);
+				}
+				REQUIRE(bsa.insert("dir"s + std::to_string(i), std::move(d)).second);
+			}
+			return bsa;
+		};
+
+		auto expected = pack();
+		expected.compress_all({ .version_ = version });
+		binary_io::any_ostream eos{ std::in_place_type<binary_io::memory_ostream> };
+		expected.write(eos, version);
+
+		const auto bsa = pack();
+		binary_io::any_ostream os{ std::in_place_type<binary_io::memory_ostream> };
+		bsa.write(os, version, { .version_ = version }, bsa::make_thread_executor(4));
+		assert_byte_equality(
+			eos.get<binary_io::memory_ostream>().rdbuf(),
+			os.get<binary_io::memory_ostream>().rdbuf());
+	}
+
 	SECTION("files can be compressed independently of the archive's compression")
 	{
 		const std::filesystem::path root{ "tes4_compression_mismatch_test"sv };
@@ -382,6 +808,14 @@ TEST_CASE("bsa::tes4::archive", "[src][tes4][archive]")
 
 		add({ 1 }, little);
 		REQUIRE(!verify());
+
+		// xbox archives write their files in another order, which changes the file written last
+		bsa.clear();
+		add({ .last = 1 }, large);
+		add({ .crc = 1 }, little);
+		REQUIRE(!verify());
+		bsa.archive_flags(bsa.archive_flags() | bsa::tes4::archive_flag::xbox_archive);
+		REQUIRE(verify());
 	}
 
 	SECTION("we can write archives with a variety of flags")
@@ -627,4 +1061,592 @@ TEST_CASE("bsa::tes4::archive", "[src][tes4][archive]")
 		find("misc1"sv, "example1.txt"sv);
 		find("misc2"sv, "example2.txt"sv);
 	}
+
+	SECTION("archives read lazily are indistinguishable from archives read eagerly")
+	{
+		constexpr std::array paths{
+			"tes4_compression_test/test_104.bsa"sv,
+			"tes4_compression_test/test_105.bsa"sv,
+			"tes4_compression_mismatch_test/test.bsa"sv,
+			"tes4_data_sharing_name_test/share.bsa"sv,
+			"tes4_xbox_read_test/xbox.bsa"sv,
+			"tes4_xbox_write_test/in.bsa"sv,
+		};
+
+		for (const auto& path : paths) {
+			bsa::tes4::archive eager;
+			const auto format = eager.read(std::filesystem::path{ path });
+
+			bsa::tes4::archive lazy;
+			REQUIRE(lazy.read(std::filesystem::path{ path }, bsa::tes4::read_mode::lazy) == format);
+
+			REQUIRE(eager.size() == lazy.size());
+			for (const auto& [dkey, deager] : eager) {
+				const auto dit = lazy.find(dkey.hash());
+				REQUIRE(dit != lazy.end());
+				REQUIRE(dit->first.name() == dkey.name());
+				REQUIRE(dit->second.size() == deager.size());
+
+				for (const auto& [fkey, feager] : deager) {
+					const auto fit = dit->second.find(fkey.hash());
+					REQUIRE(fit != dit->second.end());
+					REQUIRE(fit->first.name() == fkey.name());
+
+					const auto& flazy = fit->second;
+					REQUIRE(flazy.compressed() == feager.compressed());
+					if (feager.compressed()) {
+						REQUIRE(flazy.decompressed_size() == feager.decompressed_size());
+					}
+					assert_byte_equality(flazy.as_bytes(), feager.as_bytes());
+				}
+			}
+
+			const auto write = [&](const bsa::tes4::archive& a_archive) {
+				binary_io::any_ostream os{ std::in_place_type<binary_io::memory_ostream> };
+				a_archive.write(os, format);
+				return std::move(os.get<binary_io::memory_ostream>().rdbuf());
+			};
+
+			assert_byte_equality(write(lazy), write(eager));
+		}
+	}
+
+	SECTION("archives read lazily keep their source alive")
+	{
+		bsa::tes4::archive bsa;
+		{
+			bsa::tes4::archive temp;
+			temp.read(std::filesystem::path{ "tes4_compression_test/test_105.bsa"sv }, bsa::tes4::read_mode::lazy);
+			bsa = temp;
+		}
+
+		const auto file = bsa["."sv]["License.txt"sv];
+		REQUIRE(file);
+		REQUIRE(file->compressed());
+		file->decompress({ .version_ = bsa::tes4::version::sse });
+		REQUIRE(file->size() == std::filesystem::file_size("tes4_compression_test/License.txt"sv));
+	}
+
+	SECTION("directories moved out of an archive keep their names after the archive is gone")
+	{
+		const std::filesystem::path path{ "tes4_compression_test/test_105.bsa"sv };
+		const auto disk = map_file(path);
+		const auto read = [&](bsa::tes4::archive& a_archive, bool a_fromPath) {
+			if (a_fromPath) {
+				a_archive.read(path);
+			} else {
+				a_archive.read({ std::span{ disk.data(), disk.size() }, bsa::copy_type::deep });
+			}
+		};
+
+		for (const bool fromPath : { true, false }) {
+			bsa::tes4::directory moved;
+			std::vector<std::string> expected;
+			{
+				bsa::tes4::archive bsa;
+				read(bsa, fromPath);
+				const auto it = bsa.find("."sv);
+				REQUIRE(it != bsa.end());
+				for (const auto& file : it->second) {
+					expected.emplace_back(file.first.name());
+				}
+
+				moved = std::move(it->second);
+				bsa.read(path);
+			}
+
+			REQUIRE(moved.size() == expected.size());
+			auto name = expected.begin();
+			for (const auto& file : moved) {
+				REQUIRE(file.first.name() == *name++);
+			}
+		}
+	}
+
+	SECTION("archives read lazily bail on malformed records, either when read or when accessed")
+	{
+		const auto make = [](bsa::tes4::archive_flag a_flags) {
+			auto payload = std::vector<std::byte>(16);
+			bsa::tes4::file f;
+			f.set_data(std::move(payload));
+			bsa::tes4::directory d;
+			d.insert("file.txt"sv, std::move(f));
+			bsa::tes4::archive bsa;
+			bsa.insert("dir"sv, std::move(d));
+			bsa.archive_flags(
+				bsa::tes4::archive_flag::directory_strings |
+				bsa::tes4::archive_flag::file_strings |
+				a_flags);
+
+			binary_io::any_ostream os{ std::in_place_type<binary_io::memory_ostream> };
+			bsa.write(os, bsa::tes4::version::fo3);
+			return std::move(os.get<binary_io::memory_ostream>().rdbuf());
+		};
+
+		// the header, a single directory record, and the directory's name
+		constexpr std::size_t sizeOffset = 0x24 + 0x10 + 5 + 8;
+		constexpr std::size_t dataOffset = sizeOffset + 4;
+		const auto read32 = [](std::span<const std::byte> a_bytes, std::size_t a_pos) {
+			std::uint32_t result = 0;
+			std::memcpy(&result, a_bytes.data() + a_pos, sizeof(result));
+			return result;
+		};
+		const auto write32 = [](std::span<std::byte> a_bytes, std::size_t a_pos, std::uint32_t a_value) {
+			std::memcpy(a_bytes.data() + a_pos, &a_value, sizeof(a_value));
+		};
+
+		// a compressed record which is too short to hold its decompressed size
+		auto compressed = make(bsa::tes4::archive_flag::none);
+		REQUIRE(read32(compressed, sizeOffset) == 16);
+		write32(compressed, sizeOffset, 2u | (1u << 30u));
+
+		// an embedded name which runs past the end of its record
+		auto named = make(bsa::tes4::archive_flag::embedded_file_names);
+		const auto namePos = read32(named, dataOffset);
+		REQUIRE(read32(named, sizeOffset) == 16 + "dir\\file.txt"sv.length() + 1);
+		named[namePos] = std::byte{ 0xFF };
+
+		for (const bool embedded : { false, true }) {
+			const auto& bytes = embedded ? named : compressed;
+			for (const auto mode : { bsa::tes4::read_mode::eager, bsa::tes4::read_mode::lazy }) {
+				bsa::tes4::archive bsa;
+				if (mode == bsa::tes4::read_mode::lazy && embedded) {
+					// embedded names aren't touched until the file is, so that opening an archive
+					// doesn't fault in the data of every file
+					bsa.read({ std::span{ bytes }, bsa::copy_type::shallow }, mode);
+					const auto file = bsa["dir"sv]["file.txt"sv];
+					REQUIRE(file);
+					REQUIRE_THROWS_AS(file->as_bytes(), binary_io::buffer_exhausted);
+				} else {
+					REQUIRE_THROWS_AS(
+						bsa.read({ std::span{ bytes }, bsa::copy_type::shallow }, mode),
+						binary_io::buffer_exhausted);
+				}
+			}
+		}
+	}
+
+	SECTION("extracting files to disk is identical to extracting them in memory")
+	{
+		const std::filesystem::path root{ "tes4_extract_test"sv };
+		std::filesystem::create_directories(root);
+		const auto version = bsa::tes4::version::sse;
+
+		const auto payloads = make_payloads(32, 1);
+
+		const auto in = root / "in.bsa"sv;
+		{
+			bsa::tes4::archive bsa;
+			bsa.archive_flags(bsa::tes4::archive_flag::directory_strings | bsa::tes4::archive_flag::file_strings);
+			for (std::size_t i = 0; i < 4; ++i) {
+				bsa::tes4::directory d;
+				for (std::size_t j = i; j < payloads.size(); j += 4) {
+					bsa::tes4::file f;
+					f.set_data(std::span{ payloads[j] });
+					if (j % 3 == 0) {
+						f.compress({ .version_ = version });
+					}
+					REQUIRE(d.insert("file"s + std::to_string(j) + ".txt"s, std::move(f)).second);
+				}
+				REQUIRE(bsa.insert("dir"s + std::to_string(i), std::move(d)).second);
+			}
+			bsa.write(in, version);
+		}
+
+		const std::vector<std::byte> garbage(0x2000, std::byte{ 0xFF });
+		bsa::tes4::file leftover;
+		leftover.set_data(std::span{ garbage });
+
+		for (const auto mode : { bsa::tes4::read_mode::eager, bsa::tes4::read_mode::lazy }) {
+			bsa::tes4::archive bsa;
+			bsa.read(in, mode);
+			for (const auto& [dkey, dir] : bsa) {
+				for (const auto& [fkey, file] : dir) {
+					binary_io::any_ostream os{ std::in_place_type<binary_io::memory_ostream> };
+					file.write(os, { .version_ = version });
+
+					// whatever was on disk before is replaced entirely
+					const auto out = root / "out.txt"sv;
+					leftover.write(out, { .version_ = version });
+					file.write(out, { .version_ = version });
+
+					const auto disk = map_file(out);
+					assert_byte_equality(
+						os.get<binary_io::memory_ostream>().rdbuf(),
+						std::span{ disk.data(), disk.size() });
+				}
+			}
+		}
+	}
+
+#ifdef __linux__
+	SECTION("files read from disk only hold a descriptor open while they're being extracted")
+	{
+		const std::filesystem::path root{ "tes4_descriptor_test"sv };
+		std::filesystem::create_directories(root);
+
+		const auto count = [] {
+			return std::distance(
+				std::filesystem::directory_iterator{ "/proc/self/fd"sv },
+				std::filesystem::directory_iterator{});
+		};
+
+		const auto src = root / "in.txt"sv;
+		{
+			const std::vector<std::byte> payload(0x1000, std::byte{ 0x42 });
+			bsa::tes4::file f;
+			f.set_data(std::span{ payload });
+			f.write(src, {});
+		}
+
+		const auto before = count();
+		std::vector<bsa::tes4::file> files(64);
+		for (auto& f : files) {
+			f.read(src, {});
+		}
+		REQUIRE(count() - before <= static_cast<std::ptrdiff_t>(files.size()));
+
+		const auto out = root / "out.txt"sv;
+		files.front().write(out, {});
+		REQUIRE(count() - before <= static_cast<std::ptrdiff_t>(files.size()));
+		const auto disk = map_file(out);
+		const auto mapped = map_file(src);
+		assert_byte_equality(
+			std::span{ mapped.data(), mapped.size() },
+			std::span{ disk.data(), disk.size() });
+	}
+
+	SECTION("extracting a file whose source was replaced on disk writes what was read")
+	{
+		const std::filesystem::path root{ "tes4_replaced_test"sv };
+		std::filesystem::create_directories(root);
+
+		const std::vector<std::byte> original(0x1000, std::byte{ 0x01 });
+		const std::vector<std::byte> replacement(0x1000, std::byte{ 0x02 });
+		const auto src = root / "in.txt"sv;
+		const auto tmp = root / "tmp.txt"sv;
+		for (const auto& [path, payload] : {
+				 std::pair{ src, std::span{ original } },
+				 std::pair{ tmp, std::span{ replacement } } }) {
+			bsa::tes4::file f;
+			f.set_data(payload);
+			f.write(path, {});
+		}
+
+		bsa::tes4::file f;
+		f.read(src, {});
+		std::filesystem::rename(tmp, src);
+
+		const auto out = root / "out.txt"sv;
+		f.write(out, {});
+		const auto disk = map_file(out);
+		assert_byte_equality(
+			std::span{ original },
+			std::span{ disk.data(), disk.size() });
+	}
+#endif
+}
+
+TEST_CASE("bsa::tes4::archive benchmarks", "[.][benchmark][tes4]")
+{
+	const std::filesystem::path root{ "tes4_benchmark"sv };
+	const auto path = root / "large.bsa"sv;
+	{
+		// one record per page, so that touching a record faults in its page
+		const std::vector<std::byte> payload(0x1000);
+		bsa::tes4::archive bsa;
+		for (std::size_t i = 0; i < 200; ++i) {
+			bsa::tes4::directory d;
+			for (std::size_t j = 0; j < 100; ++j) {
+				bsa::tes4::file f;
+				f.set_data(std::span{ payload });
+				d.insert("f"s + std::to_string(j) + ".nif"s, std::move(f));
+			}
+			bsa.insert("meshes/d"s + std::to_string(i), std::move(d));
+		}
+		bsa.archive_flags(
+			bsa::tes4::archive_flag::directory_strings |
+			bsa::tes4::archive_flag::file_strings |
+			bsa::tes4::archive_flag::embedded_file_names);
+		std::filesystem::create_directories(root);
+		bsa.write(path, bsa::tes4::version::sse);
+	}
+
+	for (const auto mode : { bsa::tes4::read_mode::eager, bsa::tes4::read_mode::lazy }) {
+		const auto suffix = mode == bsa::tes4::read_mode::eager ? " (eager)"s : " (lazy)"s;
+
+		BENCHMARK("read"s + suffix)
+		{
+			bsa::tes4::archive bsa;
+			bsa.read(path, mode);
+			return bsa;
+		};
+
+		BENCHMARK("read and access one file"s + suffix)
+		{
+			bsa::tes4::archive bsa;
+			bsa.read(path, mode);
+			return bsa["meshes/d100"sv]["f50.nif"sv]->as_bytes().size();
+		};
+	}
+}
+
+TEST_CASE("bsa::tes4::archive xbox write benchmarks", "[.][benchmark][tes4]")
+{
+	bsa::tes4::archive bsa;
+	for (std::size_t i = 0; i < 1'000; ++i) {
+		bsa::tes4::directory d;
+		for (std::size_t j = 0; j < 100; ++j) {
+			d.insert("f"s + std::to_string(j) + ".nif"s, bsa::tes4::file{});
+		}
+		bsa.insert("meshes/d"s + std::to_string(i), std::move(d));
+	}
+	bsa.archive_flags(
+		bsa::tes4::archive_flag::xbox_archive |
+		bsa::tes4::archive_flag::directory_strings |
+		bsa::tes4::archive_flag::file_strings);
+
+	BENCHMARK("verify_offsets")
+	{
+		return bsa.verify_offsets(bsa::tes4::version::tes4);
+	};
+
+	BENCHMARK("write")
+	{
+		binary_io::any_ostream os{ std::in_place_type<binary_io::memory_ostream> };
+		bsa.write(os, bsa::tes4::version::tes4);
+		return os.get<binary_io::memory_ostream>().rdbuf().size();
+	};
+}
+
+TEST_CASE("bsa::tes4::archive write benchmarks", "[.][benchmark][tes4]")
+{
+	const std::filesystem::path root{ "tes4_write_benchmark"sv };
+	std::filesystem::create_directories(root);
+
+	const std::array<std::byte, 0x40> payload{};
+	bsa::tes4::archive bsa;
+	for (std::size_t i = 0; i < 1'000; ++i) {
+		bsa::tes4::directory d;
+		for (std::size_t j = 0; j < 100; ++j) {
+			bsa::tes4::file f;
+			f.set_data(std::span{ payload });
+			d.insert("f"s + std::to_string(j) + ".nif"s, std::move(f));
+		}
+		bsa.insert("meshes/d"s + std::to_string(i), std::move(d));
+	}
+	bsa.archive_flags(
+		bsa::tes4::archive_flag::directory_strings |
+		bsa::tes4::archive_flag::file_strings);
+
+	BENCHMARK("write (memory)")
+	{
+		binary_io::any_ostream os{ std::in_place_type<binary_io::memory_ostream> };
+		bsa.write(os, bsa::tes4::version::sse);
+		return os.get<binary_io::memory_ostream>().rdbuf().size();
+	};
+
+	BENCHMARK("write (file)")
+	{
+		bsa.write(root / "out.bsa"sv, bsa::tes4::version::sse);
+	};
+}
+
+TEST_CASE("bsa::tes4::archive parallel write benchmarks", "[.][benchmark][tes4]")
+{
+	const std::filesystem::path root{ "tes4_parallel_write_test"sv };
+	std::filesystem::create_directories(root);
+
+	std::vector<std::byte> payload(0x100000);
+	bsa::tes4::archive bsa;
+	for (std::size_t i = 0; i < 16; ++i) {
+		bsa::tes4::directory d;
+		for (std::size_t j = 0; j < 32; ++j) {
+			bsa::tes4::file f;
+			f.set_data(std::span{ payload });
+			d.insert("f"s + std::to_string(j) + ".dds"s, std::move(f));
+		}
+		bsa.insert("textures/d"s + std::to_string(i), std::move(d));
+	}
+
+	BENCHMARK("write")
+	{
+		bsa.write(root / "sequential.bsa"sv, bsa::tes4::version::sse);
+	};
+
+	BENCHMARK("write (parallel)")
+	{
+		bsa.write(root / "parallel.bsa"sv, bsa::tes4::version::sse, bsa::make_thread_executor());
+	};
+}
+
+TEST_CASE("bsa::tes4::archive compression benchmarks", "[.][benchmark][tes4]")
+{
+	bsa::tes4::archive bsa;
+	{
+		std::mt19937 rng;
+		std::vector<std::byte> payload(0x10000);
+		bsa::tes4::directory d;
+		for (std::size_t i = 0; i < 512; ++i) {
+			// compressible, but not trivially so
+			for (auto& b : payload) {
+				b = static_cast<std::byte>(rng() % 16);
+			}
+
+			bsa::tes4::file f;
+			f.set_data(std::vector(payload));
+			d.insert("f"s + std::to_string(i) + ".dds"s, std::move(f));
+		}
+		bsa.insert("textures"sv, std::move(d));
+	}
+
+	// zlib for tes4, lz4 for sse
+	for (const auto version : { bsa::tes4::version::tes4, bsa::tes4::version::sse }) {
+		auto compressed = bsa;
+		compressed.compress_all({ .version_ = version });
+
+		const auto codec = version == bsa::tes4::version::sse ? "lz4"s : "zlib"s;
+		const auto hardware = std::size_t{ std::thread::hardware_concurrency() };
+		for (const auto threads : { std::size_t{ 1 }, std::size_t{ 2 }, std::size_t{ 4 }, hardware }) {
+			const auto executor = bsa::make_thread_executor(threads);
+			const auto suffix = " ("s + codec + ", "s + std::to_string(threads) + " threads)"s;
+
+			BENCHMARK_ADVANCED("compress_all"s + suffix)(Catch::Benchmark::Chronometer a_meter)
+			{
+				std::vector<bsa::tes4::archive> archives(a_meter.runs(), bsa);
+				a_meter.measure([&](int a_idx) { archives[a_idx].compress_all({ .version_ = version }, executor); });
+			};
+
+			BENCHMARK_ADVANCED("decompress_all"s + suffix)(Catch::Benchmark::Chronometer a_meter)
+			{
+				std::vector<bsa::tes4::archive> archives(a_meter.runs(), compressed);
+				a_meter.measure([&](int a_idx) { archives[a_idx].decompress_all({ .version_ = version }, executor); });
+			};
+		}
+	}
+}
+
+TEST_CASE("bsa::tes4::file decompression benchmarks", "[.][benchmark][tes4]")
+{
+	constexpr auto version = bsa::tes4::version::sse;
+
+	// lots of tiny files, where setting up the codec costs as much as running it
+	std::mt19937 rng;
+	std::vector<bsa::tes4::file> files(100'000);
+	for (auto& f : files) {
+		std::vector<std::byte> payload(0x100);
+		for (auto& b : payload) {
+			b = static_cast<std::byte>(rng() % 16);
+		}
+
+		f.set_data(std::move(payload));
+		f.compress({ .version_ = version });
+	}
+
+	std::vector<std::byte> buffer(0x100);
+	BENCHMARK("decompress_into (lz4)")
+	{
+		for (const auto& f : files) {
+			f.decompress_into(buffer, { .version_ = version });
+		}
+		return buffer.front();
+	};
+}
+
+TEST_CASE("bsa::tes4::file compression preset benchmarks", "[.][benchmark][tes4]")
+{
+	// text-like data, which compresses well enough for the presets to differ
+	constexpr std::array words{
+		"the "sv, "of "sv, "and "sv, "a "sv, "to "sv, "in "sv, "is "sv, "you "sv,
+		"that "sv, "it "sv, "dragon "sv, "sword "sv, "shout "sv, "whiterun "sv, "jarl "sv, "\n"sv,
+	};
+
+	std::mt19937 rng;
+	std::vector<bsa::tes4::file> files(256);
+	std::size_t total = 0;
+	for (auto& f : files) {
+		std::vector<std::byte> payload;
+		while (payload.size() < 0x4000) {
+			const auto word = words[rng() % words.size()];
+			for (const auto c : word) {
+				payload.push_back(static_cast<std::byte>(c));
+			}
+		}
+		total += payload.size();
+		f.set_data(std::move(payload));
+	}
+
+	const std::array presets{
+		std::make_pair(bsa::compression_preset::fast, "fast"s),
+		std::make_pair(bsa::compression_preset::normal, "normal"s),
+		std::make_pair(bsa::compression_preset::max, "max"s),
+	};
+	for (const auto version : { bsa::tes4::version::tes4, bsa::tes4::version::sse }) {
+		const auto codec = version == bsa::tes4::version::sse ? "lz4"s : "zlib"s;
+		for (const auto& [preset, name] : presets) {
+			const bsa::tes4::file::compression_params params{
+				.version_ = version,
+				.compression_preset_ = preset,
+			};
+
+			std::size_t bound = 0;
+			for (const auto& f : files) {
+				bound = std::max(bound, f.compress_bound(params));
+			}
+
+			std::vector<std::byte> buffer(bound);
+			const auto compress = [&]() {
+				std::size_t size = 0;
+				for (const auto& f : files) {
+					size += f.compress_into(buffer, params);
+				}
+				return size;
+			};
+
+			// the ratio is part of the name, so it shows up next to the timings
+			const auto ratio = compress() * 100 / total;
+			BENCHMARK("compress_into ("s + codec + ", "s + name + ", "s + std::to_string(ratio) + "% of original)"s)
+			{
+				return compress();
+			};
+		}
+	}
+}
+
+TEST_CASE("bsa::tes4::file zlib benchmarks", "[.][benchmark][tes4]")
+{
+	constexpr auto version = bsa::tes4::version::tes4;
+
+	std::mt19937 rng;
+	std::vector<bsa::tes4::file> files(100'000);
+	for (auto& f : files) {
+		std::vector<std::byte> payload(0x100);
+		for (auto& b : payload) {
+			b = static_cast<std::byte>(rng() % 16);
+		}
+		f.set_data(std::move(payload));
+	}
+
+	auto compressed = files;
+	for (auto& f : compressed) {
+		f.compress({ .version_ = version });
+	}
+
+	std::vector<std::byte> buffer(files.front().compress_bound({ .version_ = version }));
+	BENCHMARK("compress_into (zlib)")
+	{
+		std::size_t size = 0;
+		for (const auto& f : files) {
+			size += f.compress_into(buffer, { .version_ = version });
+		}
+		return size;
+	};
+
+	BENCHMARK("decompress_into (zlib)")
+	{
+		for (const auto& f : compressed) {
+			f.decompress_into(buffer, { .version_ = version });
+		}
+		return buffer.front();
+	};
 }
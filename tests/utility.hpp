@@ -11,6 +11,7 @@
 #include <filesystem>
 #include <functional>
 #include <initializer_list>
+#include <random>
 #include <span>
 #include <string>
 #include <string_view>
@@ -113,6 +114,23 @@ inline auto make_substr_matcher(std::string_view a_str) noexcept
 	};
 }
 
+// compressible payloads of random lengths, which are the same on every run
+[[nodiscard]] inline auto make_payloads(
+	std::size_t a_count,
+	std::size_t a_minSize = 0)
+	-> std::vector<std::vector<std::byte>>
+{
+	std::mt19937 rng;
+	std::vector<std::vector<std::byte>> payloads;
+	for (std::size_t i = 0; i < a_count; ++i) {
+		auto& payload = payloads.emplace_back(rng() % 0x1000 + a_minSize);
+		for (auto& b : payload) {
+			b = static_cast<std::byte>(rng() % 8);
+		}
+	}
+	return payloads;
+}
+
 inline void assert_byte_equality(
 	std::span<const std::byte> a_lhs,
 	std::span<const std::byte> a_rhs)